@@ -0,0 +1,245 @@
+/*
+*
+* this file benchmarks the join methods on synthetic graphs
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <boost/mpi.hpp>
+#include <boost/mpi/collectives.hpp>
+#include <boost/serialization/string.hpp>
+#include "catalog.h"
+#include "communicator.h"
+#include "generator.h"
+#include "ioutil.h"
+#include "mpiutil.h"
+#include "util.h"
+#include "settings.h"
+
+using namespace std;
+
+/* a query over the edges of the graph, and its symmetry-breaking predicates */
+struct Query {
+	vector<vector<int>> varsv;
+	vector<Predicate> predicates;
+};
+
+map<string, Query> make_queries()
+{
+	auto lt = [](int x, int y) { return Predicate{x, CompareOp::Lt, false, y}; };
+	auto ne = [](int x, int y) { return Predicate{x, CompareOp::Ne, false, y}; };
+	map<string, Query> queries;
+	// every triangle, cycle and star once; every simple path once per pair of ends
+	queries["triangle"] = Query{{{0, 1}, {1, 2}, {2, 0}}, {lt(0, 1), lt(1, 2)}};
+	queries["cycle4"] = Query{{{0, 1}, {1, 2}, {2, 3}, {3, 0}}, {lt(0, 1), lt(0, 2), lt(0, 3), lt(1, 3)}};
+	queries["path3"] = Query{{{0, 1}, {1, 2}, {2, 3}}, {ne(0, 2), ne(1, 3), lt(0, 3)}};
+	queries["star3"] = Query{{{0, 1}, {0, 2}, {0, 3}}, {lt(1, 2), lt(2, 3)}};
+	return queries;
+}
+
+void throw_error(string s =
+	"Usage: mpirun -np <number of processes> bin/bench_join <graph> [<queries> [<algorithms> [<hashes> [<repetitions>]]]]\n"
+	"<graph>: er:<vertices>:<average degree>, rmat:<scale>:<average degree>[:<a>] or ba:<vertices>:<k>\n"
+	"<queries>, <algorithms>, <hashes>: comma-separated lists (default: all of them)"){
+	mpi::communicator world;
+	if(world.rank() == constants::ROOT){
+			cout<<"###################"<<endl;
+			cout<<s<<endl;
+			cout<<"###################"<<endl;
+	}
+	exit(-1);
+}
+
+vector<string> split(const string& s, char sep)
+{
+	vector<string> parts;
+	stringstream stream(s);
+	for (string part; getline(stream, part, sep);)
+		parts.push_back(part);
+	return parts;
+}
+
+/*
+ * Generates the graph described by spec (see the usage)
+ */
+Relation<int> generate_graph(const string& spec)
+{
+	auto fields = split(spec, ':');
+	if (fields.size() < 3)
+		throw_error("Invalid graph: " + spec);
+	uint64_t seed = settings::hash_seed;
+	try {
+		if (fields[0] == "er") {
+			int n = stoi(fields[1]);
+			return erdos_renyi_graph(n, (size_t) n * stoi(fields[2]) / 2, seed);
+		} else if (fields[0] == "rmat") {
+			int scale = stoi(fields[1]);
+			double a = fields.size() > 3 ? stod(fields[3]) : 0.57, bc = (1 - a) / 3;
+			return rmat_graph(scale, ((size_t) 1 << scale) * stoi(fields[2]) / 2, a, bc, bc, seed);
+		} else if (fields[0] == "ba") {
+			return barabasi_albert_graph(stoi(fields[1]), stoi(fields[2]), seed);
+		}
+	} catch (std::exception&) {
+	}
+	throw_error("Invalid graph: " + spec);
+	return Relation<int>(2);
+}
+
+int main(int argc, char* argv[]) {
+
+	mpi::environment env(argc, argv);
+	mpi::communicator world;
+	std::map<string, HashMethod> list_names_hash;
+	list_names_hash[string("mod_hash")]= HashMethod::ModHash;
+	list_names_hash[string("mult_hash")]= HashMethod::MultHash;
+	list_names_hash[string("murmur_hash")]= HashMethod::MurmurHash;
+	list_names_hash[string("tab_hash")]= HashMethod::TabulationHash;
+	auto all_queries = make_queries();
+
+	try {
+		parse_settings(argc, argv);
+	} catch (std::invalid_argument& e) {
+		throw_error(e.what());
+	}
+	if(argc < 2)
+		throw_error();
+
+	vector<string> query_names = split(argc > 2 ? argv[2] : "triangle,cycle4,path3,star3", ',');
+	vector<string> algorithms = split(argc > 3 ? argv[3] : "sequential,normal_distrib,optimized_distrib,hypercube", ',');
+	vector<string> hashes = split(argc > 4 ? argv[4] : "mod_hash,mult_hash,murmur_hash,tab_hash", ',');
+	int repetitions = argc > 5 ? atoi(argv[5]) : 3;
+	for (auto& name : query_names)
+		if (!all_queries.count(name))
+			throw_error("Invalid query: " + name);
+	for (auto& name : algorithms)
+		if (name != "sequential" && name != "normal_distrib" && name != "optimized_distrib" && name != "hypercube")
+			throw_error("Invalid algorithm option: " + name);
+	for (auto& name : hashes)
+		if (!list_names_hash.count(name))
+			throw_error("Invalid hash method: " + name);
+	if (repetitions < 1)
+		throw_error("Invalid number of repetitions");
+
+	// the root generates the graph and writes it where every process can read it
+	string graph_file;
+	size_t graph_size = 0;
+	if (world.rank() == constants::ROOT) {
+		auto start = chrono::steady_clock::now();
+		Relation<int> graph = generate_graph(argv[1]);
+		graph_size = graph.size();
+		map<int, size_t> degrees;
+		size_t max_degree = 0;
+		for (auto& edge : graph)
+			max_degree = max(max_degree, ++degrees[edge[0]]);
+		graph_file = settings::scratch_dir + "/graph-" + to_string(getpid()) + ".txt";
+		write_relation(graph_file, graph);
+		cout << "graph " << argv[1] << ": " << degrees.size() << " vertices, "
+		     << graph_size / 2 << " edges, max degree " << max_degree << " (generated in "
+		     << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s)" << endl;
+	}
+	mpi::broadcast(world, graph_file, constants::ROOT);
+	mpi::broadcast(world, graph_size, constants::ROOT);
+
+	for (auto& query_name : query_names) {
+		Query& query = all_queries[query_name];
+		vector<string> rel_namesv(query.varsv.size(), graph_file);
+		for (auto& name_algorithm : algorithms) {
+			// the sequential join has no hash function
+			vector<string> run_hashes = (name_algorithm == "sequential") ? vector<string>{"-"} : hashes;
+			for (auto& name_hash : run_hashes) {
+				HashMethod hash_method = list_names_hash.count(name_hash) ? list_names_hash[name_hash] : HashMethod::ModHash;
+				vector<double> times;
+				size_t tuples = 0;
+				// volume of the last run: tuples received by the busiest process,
+				// tuples received by all of them and bytes sent
+				size_t max_load = 0, received = 0, shuffled_bytes = 0;
+				for (int rep = 0; rep < repetitions; rep++) {
+					// every run reads and partitions the graph again, so the runs are alike
+					function<void()> run = [&]() {
+						Communicator& comm = current_communicator();
+						relation_catalog().clear();
+						comm.barrier();
+						auto start = chrono::steady_clock::now();
+						Relation<int> result;
+						vector<int> result_vars;
+						size_t first_shuffle = shuffle_log().size();
+						if(name_algorithm == "normal_distrib")
+							result = distributed_multiway_join(rel_namesv, query.varsv, result_vars, false, hash_method,
+											   settings::result_limit, query.predicates);
+						else if(name_algorithm =="optimized_distrib")
+							result = distributed_multiway_join(rel_namesv, query.varsv, result_vars, true, hash_method,
+											   settings::result_limit, query.predicates);
+						else if(name_algorithm == "hypercube")
+							result = hypercube_distributed_multiway_join(rel_namesv, query.varsv, result_vars, hash_method,
+												     settings::result_limit, query.predicates);
+						comm.barrier();
+						double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+						// the shuffles of this run but the final gather of the result, the same for every algorithm
+						auto& log = shuffle_log();
+						size_t end = log.size() - (settings::gather_result ? 1 : 0);
+						vector<size_t> load{0}, volume{0, 0}, count{result.size()};
+						for (size_t i = first_shuffle; i < end; i++) {
+							load[0] += log[i].received;
+							volume[0] += log[i].received;
+							volume[1] += log[i].sent_bytes;
+						}
+						comm.reduce(load, ReduceOp::Max, constants::ROOT);
+						comm.reduce(volume, ReduceOp::Sum, constants::ROOT);
+						if (!settings::gather_result) // the result is left in parts
+							comm.reduce(count, ReduceOp::Sum, constants::ROOT);
+						if (comm.rank() == constants::ROOT) {
+							times.push_back(seconds);
+							tuples = count[0];
+							max_load = load[0];
+							received = volume[0];
+							shuffled_bytes = volume[1];
+						}
+					};
+					if (name_algorithm == "sequential") {
+						// computed by the root alone
+						if (world.rank() == constants::ROOT) {
+							relation_catalog().clear();
+							auto start = chrono::steady_clock::now();
+							vector<int> result_vars;
+							tuples = multiway_join(rel_namesv, query.varsv, result_vars,
+									       settings::result_limit, query.predicates).size();
+							times.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+						}
+					} else if (settings::threads > 0)
+						run_on_threads(settings::threads, run);
+					else
+						run();
+				}
+
+				if (world.rank() == constants::ROOT) {
+					sort(times.begin(), times.end());
+					double mean = 0;
+					for (double t : times)
+						mean += t / times.size();
+					double median = times[times.size() / 2];
+					cout << query_name << " " << name_algorithm << " " << name_hash << ": "
+					     << tuples << " tuples, time min " << times.front() << " s, median " << median
+					     << " s, mean " << mean << " s, max " << times.back() << " s, "
+					     << tuples / median << " result tuples/s, "
+					     << graph_size * rel_namesv.size() / median << " input tuples/s, max load "
+					     << max_load << " tuples, replication " << (double) received / (graph_size * rel_namesv.size())
+					     << ", " << shuffled_bytes << " bytes shuffled" << endl;
+				}
+			}
+		}
+	}
+
+	relation_catalog().clear();
+	world.barrier();
+	if (world.rank() == constants::ROOT)
+		remove(graph_file.c_str());
+
+	return 0;
+}
@@ -0,0 +1,357 @@
+/*
+*
+* this file benchmarks the kernels of the join algorithms (hash functions,
+* partitioning, sort and local join) on generated relations, and checks
+* each one against a straightforward reference implementation
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+#include "hash.h"
+#include "mpiutil.h"
+#include "util.h"
+#include "settings.h"
+
+using namespace std;
+
+/* parts of the partitioning kernels, and processes of the hypercube */
+const int NPARTS = 16;
+
+void throw_error(string s =
+	"Usage: bin/bench_kernels [<kernels> [<sizes> [<arities> [<key cardinalities> [<skews> [<repetitions>]]]]]]\n"
+	"<kernels>: comma-separated list of hash, sort, join, divide and hypercube (default: all of them)\n"
+	"<sizes>, <arities>, <key cardinalities>, <skews>: comma-separated lists of numbers;\n"
+	"the keys follow a Zipf law of the given exponent (0: uniform)"){
+	cout<<"###################"<<endl;
+	cout<<s<<endl;
+	cout<<"###################"<<endl;
+	exit(-1);
+}
+
+vector<string> split(const string& s, char sep)
+{
+	vector<string> parts;
+	stringstream stream(s);
+	for (string part; getline(stream, part, sep);)
+		parts.push_back(part);
+	return parts;
+}
+
+vector<double> parse_numbers(const string& s)
+{
+	vector<double> values;
+	try {
+		for (auto& field : split(s, ','))
+			values.push_back(stod(field));
+	} catch (std::exception&) {
+		throw_error("Invalid list: " + s);
+	}
+	return values;
+}
+
+/* an input of the benchmarks */
+struct Config {
+	size_t size;
+	int arity;
+	int keys;
+	double skew;
+};
+
+/*
+ * Generates a relation whose first column (the key) takes values in
+ * [0, keys) following a Zipf law of exponent skew, the smallest values
+ * being the most frequent; the other columns are uniform
+ */
+Relation<int> generate_relation(const Config& config, mt19937_64& random)
+{
+	vector<double> cdf(config.keys);
+	double total = 0;
+	for (int i = 0; i < config.keys; i++)
+		cdf[i] = total += pow(i + 1, -config.skew);
+	uniform_real_distribution<double> coin(0, total);
+	uniform_int_distribution<int> value(0, numeric_limits<int>::max());
+
+	Relation<int> rel(config.arity);
+	Relation<int>::tuple_t tpl(config.arity);
+	for (size_t i = 0; i < config.size; i++) {
+		tpl[0] = min<int>(lower_bound(cdf.begin(), cdf.end(), coin(random)) - cdf.begin(), config.keys - 1);
+		for (int j = 1; j < config.arity; j++)
+			tpl[j] = value(random);
+		rel.push_tuple(tpl);
+	}
+
+	return rel;
+}
+
+/* best of the repetitions of a kernel: elapsed time and time stamp counter ticks */
+struct Measure {
+	double seconds;
+	uint64_t cycles;
+};
+
+static uint64_t cycles_now()
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Runs a kernel repetitions times and keeps the fastest run. prepare
+ * builds the input of a run and is not timed; run is the kernel.
+ */
+Measure measure(int repetitions, const function<void()>& prepare, const function<void()>& run)
+{
+	Measure best{numeric_limits<double>::max(), numeric_limits<uint64_t>::max()};
+	for (int rep = 0; rep < repetitions; rep++) {
+		prepare();
+		auto start = chrono::steady_clock::now();
+		uint64_t start_cycles = cycles_now();
+		run();
+		uint64_t cycles = cycles_now() - start_cycles;
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		best.seconds = min(best.seconds, seconds);
+		best.cycles = min(best.cycles, cycles);
+	}
+	return best;
+}
+
+void report(const string& kernel, const Config& config, size_t tuples, const Measure& m, bool ok)
+{
+	printf("%-22s %10zu %5d %10d %5.2f %14.0f", kernel.c_str(), config.size, config.arity,
+	       config.keys, config.skew, tuples / m.seconds);
+#ifdef HAVE_TSC
+	printf(" %12.2f", (double) m.cycles / tuples);
+#else
+	printf(" %12s", "n/a");
+#endif
+	printf("  %s\n", ok ? "ok" : "MISMATCH");
+	fflush(stdout);
+}
+
+/* sort on every column against std::sort of the tuples (lexicographic order) */
+bool bench_sort(Relation<int>& input, const Config& config, int repetitions)
+{
+	vector<int> perm(config.arity);
+	for (int i = 0; i < config.arity; i++)
+		perm[i] = i;
+	Relation<int> rel;
+	Measure m = measure(repetitions, [&]() { rel = input; }, [&]() { sort(rel, perm); });
+
+	vector<vector<int>> expected(input.begin(), input.end());
+	std::sort(expected.begin(), expected.end());
+	vector<vector<int>> got(rel.begin(), rel.end());
+	bool ok = got == expected;
+	report("sort", config, input.size(), m, ok);
+	return ok;
+}
+
+/*
+ * Foreign key join of the relation with a table holding every key
+ * once, so that the result has one tuple per input tuple. Both sides
+ * are sorted beforehand, so this times the merge. The reference is a
+ * hash join.
+ */
+bool bench_join(Relation<int>& input, const Config& config, int repetitions)
+{
+	vector<int> vars1(config.arity), vars2{0, config.arity};
+	for (int i = 0; i < config.arity; i++)
+		vars1[i] = i;
+	Relation<int> table(2);
+	for (int key = 0; key < config.keys; key++)
+		table.push_tuple({key, -key});
+	table.set_order({0, 1});
+	Relation<int> sorted = input;
+	sort(sorted, vars1);
+
+	Relation<int> rel1, rel2, result;
+	Measure m = measure(repetitions, [&]() { rel1 = sorted; rel2 = table; },
+			    [&]() { result = join(rel1, rel2, vars1, vars2); });
+
+	// the result has the variables of the relation, then the one of the table
+	unordered_multimap<int, int> index;
+	for (auto& tpl : table)
+		index.emplace(tpl[0], tpl[1]);
+	vector<vector<int>> expected;
+	for (auto& tpl : input) {
+		auto range = index.equal_range(tpl[0]);
+		for (auto it = range.first; it != range.second; it++) {
+			expected.push_back(tpl);
+			expected.back().push_back(it->second);
+		}
+	}
+	vector<vector<int>> got(result.begin(), result.end());
+	std::sort(expected.begin(), expected.end());
+	std::sort(got.begin(), got.end());
+	bool ok = got == expected;
+	report("join", config, input.size() + table.size(), m, ok);
+	return ok;
+}
+
+/* batched hash of the keys against the hash of every key alone */
+template<typename Hash>
+bool bench_hash(const string& name, Relation<int>& input, const Config& config, int repetitions)
+{
+	Hash hash(settings::hash_seed);
+	vector<unsigned> keys, out(input.size());
+	keys.reserve(input.size());
+	for (auto& tpl : input)
+		keys.push_back(tpl[0]);
+	Measure m = measure(repetitions, []() {}, [&]() {
+		hash_batch(hash, keys.data(), keys.size(), NPARTS, out.data());
+	});
+
+	bool ok = true;
+	for (size_t i = 0; i < keys.size() && ok; i++)
+		ok = out[i] == hash(keys[i], NPARTS) && out[i] < (unsigned) NPARTS;
+	report("hash " + name, config, keys.size(), m, ok);
+	return ok;
+}
+
+/* partitioning on the key against the hash of every tuple alone */
+template<typename Hash>
+bool bench_divide(const string& name, HashMethod method, Relation<int>& input,
+		  const Config& config, int repetitions)
+{
+	Relation<int> rel = input;
+	vector<Relation<int>> parts;
+	Measure m = measure(repetitions, []() {}, [&]() {
+		parts = divide_tuples(rel, {0}, method, NPARTS, settings::hash_seed);
+	});
+
+	Hash hash(settings::hash_seed);
+	bool ok = (int) parts.size() == NPARTS;
+	size_t total = 0;
+	for (int part = 0; part < NPARTS && ok; part++) {
+		total += parts[part].size();
+		for (auto& tpl : parts[part])
+			ok = ok && (int) hash(tpl[0], NPARTS) == part;
+	}
+	ok = ok && total == input.size();
+	report("divide " + name, config, input.size(), m, ok);
+	return ok;
+}
+
+/*
+ * Hypercube partitioning (calculate_destinations) of a relation over
+ * the first arity variables out of arity + 1, so that every tuple is
+ * replicated along the last dimension, against the enumeration of all
+ * the processes whose address matches the tuple
+ */
+template<typename Hash>
+bool bench_hypercube(const string& name, HashMethod method, Relation<int>& input,
+		     const Config& config, int repetitions)
+{
+	int num_vars = config.arity + 1;
+	vector<int> vars(config.arity), limits = equally_factorize(NPARTS, num_vars);
+	for (int i = 0; i < config.arity; i++)
+		vars[i] = i;
+	Relation<int> rel = input;
+	vector<Relation<int>> parts;
+	Measure m = measure(repetitions, [&]() { parts.assign(NPARTS, Relation<int>(config.arity)); }, [&]() {
+		hypercube_divide_tuples(rel, parts, vars, limits, method, settings::hash_seed);
+	});
+
+	// the address of process p has digit (p / (m_0 * ... * m_(v-1))) % m_v for variable v
+	vector<Hash> hashes;
+	for (int dim = 0; dim < num_vars; dim++)
+		hashes.emplace_back(derive_seed(settings::hash_seed, dim));
+	vector<vector<vector<int>>> expected(NPARTS), got(NPARTS);
+	for (auto& tpl : input)
+		for (int proc = 0; proc < NPARTS; proc++) {
+			bool matches = true;
+			for (int v = 0, rest = proc; v < num_vars; rest /= limits[v], v++)
+				if (v < config.arity)
+					matches = matches && (int) hashes[v](tpl[v], limits[v]) == rest % limits[v];
+			if (matches)
+				expected[proc].push_back(tpl);
+		}
+	for (int proc = 0; proc < NPARTS; proc++)
+		got[proc].assign(parts[proc].begin(), parts[proc].end());
+	bool ok = got == expected;
+	report("hypercube " + name, config, input.size(), m, ok);
+	return ok;
+}
+
+/* runs the kernels that depend on the hash function */
+template<typename Hash>
+bool bench_hash_kernels(const string& name, HashMethod method, const vector<string>& kernels,
+			Relation<int>& input, const Config& config, int repetitions)
+{
+	bool ok = true;
+	if (find(kernels.begin(), kernels.end(), "hash") != kernels.end())
+		ok = bench_hash<Hash>(name, input, config, repetitions) && ok;
+	if (find(kernels.begin(), kernels.end(), "divide") != kernels.end())
+		ok = bench_divide<Hash>(name, method, input, config, repetitions) && ok;
+	if (find(kernels.begin(), kernels.end(), "hypercube") != kernels.end())
+		ok = bench_hypercube<Hash>(name, method, input, config, repetitions) && ok;
+	return ok;
+}
+
+int main(int argc, char* argv[]) {
+
+	try {
+		parse_settings(argc, argv);
+	} catch (std::invalid_argument& e) {
+		throw_error(e.what());
+	}
+
+	vector<string> kernels = split(argc > 1 ? argv[1] : "hash,sort,join,divide,hypercube", ',');
+	vector<double> sizes = parse_numbers(argc > 2 ? argv[2] : "1000000");
+	vector<double> arities = parse_numbers(argc > 3 ? argv[3] : "2,3");
+	vector<double> cardinalities = parse_numbers(argc > 4 ? argv[4] : "1000,1000000");
+	vector<double> skews = parse_numbers(argc > 5 ? argv[5] : "0,1");
+	int repetitions = argc > 6 ? atoi(argv[6]) : 5;
+	for (auto& name : kernels)
+		if (name != "hash" && name != "sort" && name != "join" && name != "divide" && name != "hypercube")
+			throw_error("Invalid kernel: " + name);
+	for (double arity : arities)
+		if (arity < 1)
+			throw_error("Invalid arity");
+	for (double keys : cardinalities)
+		if (keys < 1)
+			throw_error("Invalid key cardinality");
+	if (repetitions < 1)
+		throw_error("Invalid number of repetitions");
+
+	printf("%-22s %10s %5s %10s %5s %14s %12s  %s\n", "kernel", "tuples", "arity", "keys", "skew",
+	       "tuples/s", "cycles/tuple", "check");
+	bool ok = true;
+	mt19937_64 random(settings::hash_seed);
+	for (double size : sizes)
+		for (double arity : arities)
+			for (double keys : cardinalities)
+				for (double skew : skews) {
+					Config config{(size_t) size, (int) arity, (int) keys, skew};
+					Relation<int> input = generate_relation(config, random);
+					if (find(kernels.begin(), kernels.end(), "sort") != kernels.end())
+						ok = bench_sort(input, config, repetitions) && ok;
+					if (find(kernels.begin(), kernels.end(), "join") != kernels.end())
+						ok = bench_join(input, config, repetitions) && ok;
+					ok = bench_hash_kernels<ModHash>("mod_hash", HashMethod::ModHash,
+									 kernels, input, config, repetitions) && ok;
+					ok = bench_hash_kernels<MultHash>("mult_hash", HashMethod::MultHash,
+									  kernels, input, config, repetitions) && ok;
+					ok = bench_hash_kernels<MurmurHash>("murmur_hash", HashMethod::MurmurHash,
+									    kernels, input, config, repetitions) && ok;
+					ok = bench_hash_kernels<TabulationHash>("tab_hash", HashMethod::TabulationHash,
+										kernels, input, config, repetitions) && ok;
+				}
+
+	return ok ? 0 : 1;
+}
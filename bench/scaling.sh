@@ -0,0 +1,125 @@
+#!/bin/bash
+#
+# Strong and weak scaling study of the distributed algorithms: runs
+# bin/bench_join (see "make bench") on 1..N processes of the local MPI
+# launcher, writes one CSV row per run and prints the speedup and the
+# efficiency of every algorithm relative to the fewest processes.
+
+usage() {
+	cat >&2 <<EOF
+Usage: bench/scaling.sh [options] <graph> [-- <flags of bench_join>]
+<graph>: as for bin/bench_join; in weak scaling the graph of P processes
+	 has P times the vertices of <graph> (for rmat, scale + log2 P)
+Options:
+	-m strong|weak	kind of study (default: strong)
+	-p <list>	numbers of processes (default: 1 2 4 ... up to the number of cores)
+	-q <query>	query (default: triangle)
+	-a <list>	comma-separated algorithms (default: normal_distrib,optimized_distrib,hypercube)
+	-H <list>	comma-separated hash methods (default: mult_hash)
+	-r <n>		repetitions of every run, the median time is kept (default: 3)
+	-o <file>	CSV file (default: scaling-<mode>.csv)
+The launcher is \$MPIRUN (default: mpirun), called as \$MPIRUN -np <P> ...
+EOF
+	exit 1
+}
+
+mode=strong
+procs=
+query=triangle
+algorithms=normal_distrib,optimized_distrib,hypercube
+hashes=mult_hash
+repetitions=3
+csv=
+while getopts "m:p:q:a:H:r:o:" opt; do
+	case $opt in
+		m) mode=$OPTARG ;;
+		p) procs=$OPTARG ;;
+		q) query=$OPTARG ;;
+		a) algorithms=$OPTARG ;;
+		H) hashes=$OPTARG ;;
+		r) repetitions=$OPTARG ;;
+		o) csv=$OPTARG ;;
+		*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -ge 1 ] || usage
+graph=$1
+shift
+[ "$1" = "--" ] && shift
+[ "$mode" = strong ] || [ "$mode" = weak ] || usage
+csv=${csv:-scaling-$mode.csv}
+MPIRUN=${MPIRUN:-mpirun}
+bench=$(dirname "$0")/../bin/bench_join
+[ -x "$bench" ] || { echo "$bench not found, run make bench" >&2; exit 1; }
+
+if [ -z "$procs" ]; then
+	cores=$(nproc 2>/dev/null || getconf _NPROCESSORS_ONLN)
+	for ((p = 1; p <= cores; p *= 2)); do
+		procs="$procs $p"
+	done
+fi
+
+# graph of P processes: the same one for strong scaling, P times larger for weak scaling
+scaled_graph() {
+	local p=$1 kind size rest
+	IFS=: read -r kind size rest <<< "$graph"
+	if [ "$mode" = strong ] || [ "$p" -eq 1 ]; then
+		echo "$graph"
+	elif [ "$kind" = rmat ]; then
+		local log=0
+		while [ $((1 << log)) -lt "$p" ]; do log=$((log + 1)); done
+		if [ $((1 << log)) -ne "$p" ]; then
+			echo "weak scaling of rmat graphs needs powers of two processes" >&2
+			exit 1
+		fi
+		echo "$kind:$((size + log)):$rest"
+	else
+		echo "$kind:$((size * p)):$rest"
+	fi
+}
+
+echo "mode,processes,graph,vertices,edges,query,algorithm,hash,result_tuples,time,max_load,replication,bytes_shuffled" > "$csv"
+for p in $procs; do
+	spec=$(scaled_graph "$p") || exit 1
+	echo "$p processes, graph $spec" >&2
+	$MPIRUN -np "$p" "$bench" "$spec" "$query" "$algorithms" "$hashes" "$repetitions" "$@" |
+	awk -v mode="$mode" -v p="$p" -v spec="$spec" '
+		/^graph / { vertices = $3; edges = $5 }
+		/ input tuples\/s/ {
+			sub(":", "", $3)
+			for (i = 1; i <= NF; i++) {
+				if ($i == "median") time = $(i + 1)
+				if ($i == "load") load = $(i + 1)
+				if ($i == "replication") { replication = $(i + 1); sub(",", "", replication) }
+				if ($i == "shuffled") bytes = $(i - 2)
+			}
+			print mode "," p "," spec "," vertices "," edges "," $1 "," $2 "," $3 "," $4 "," \
+				time "," load "," replication "," bytes
+		}' >> "$csv"
+	[ "${PIPESTATUS[0]}" -eq 0 ] || { echo "run on $p processes failed" >&2; exit 1; }
+done
+
+# speedup and efficiency against the run on the fewest processes of the same algorithm and hash:
+# strong scaling, speedup T(P0) / T(P) and efficiency speedup * P0 / P;
+# weak scaling, efficiency T(P0) / T(P) and scaled speedup efficiency * P / P0
+echo
+awk -F, -v mode="$mode" '
+	NR == 1 { next }
+	{
+		key = $7 " " $8
+		if (!(key in base_p)) { base_p[key] = $2; base_t[key] = $10; keys[++n] = key }
+		ratio = ($10 > 0) ? base_t[key] / $10 : 0
+		if (mode == "strong") { speedup = ratio; efficiency = ratio * base_p[key] / $2 }
+		else { efficiency = ratio; speedup = ratio * $2 / base_p[key] }
+		rows[key] = rows[key] sprintf("%-28s %5d %10.4f %10.2f %10.2f %12d %11.2f %14d\n",
+			key, $2, $10, speedup, efficiency, $11, $12, $13)
+	}
+	END {
+		printf "%-28s %5s %10s %10s %10s %12s %11s %14s\n", "algorithm hash", "procs", "time (s)",
+			"speedup", "efficiency", "max load", "replication", "bytes shuffled"
+		for (i = 1; i <= n; i++)
+			printf "%s", rows[keys[i]]
+	}' "$csv"
+echo
+echo "results written to $csv"
@@ -0,0 +1,81 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <string>
+#include <vector>
+#include "relation.h"
+
+enum class AggregateOp {Count, Sum, Min, Max};
+
+/* aggregate of a group: its number of tuples, or the sum, minimum or maximum of a variable */
+struct Aggregate {
+	AggregateOp op;
+	int var; // aggregated variable (ignored by count)
+};
+
+/*
+ * Group-by aggregation of the result of a query: one tuple per
+ * distinct value of group_vars, followed by the aggregates of the
+ * tuples of that group. The result of a join is a multiset, so a
+ * group counts each of its tuples as many times as it appears.
+ * Without aggregates there is no aggregation.
+ */
+struct GroupBy {
+	std::vector<int> group_vars;
+	std::vector<Aggregate> aggregates;
+
+	bool empty() const { return aggregates.empty(); }
+};
+
+/*
+ * Parses an aggregate of a query file, e.g. "count" or "max 2"
+ *
+ * @param op one of count, sum, min, max
+ * @param var aggregated variable (ignored by count)
+ * @throw std::invalid_argument if op is unknown
+ */
+Aggregate parse_aggregate(const std::string& op, int var);
+
+/*
+ * Variables of the result of an aggregation: the group variables, then
+ * one new variable per aggregate, numbered after those of the query
+ *
+ * @param group_by aggregation
+ * @param vars variables of the aggregated relation
+ */
+std::vector<int> aggregate_vars(const GroupBy& group_by, const std::vector<int>& vars);
+
+/*
+ * Groups the tuples of a relation and computes the aggregates of every
+ * group. The relation is sorted on the group variables (and consumed),
+ * and so is the result. Without group variables, the result has a
+ * single tuple even if the relation is empty: counts and sums are 0,
+ * minima INT_MAX and maxima INT_MIN.
+ *
+ * @param rel relation to aggregate
+ * @param vars variables of the relation
+ * @param group_by aggregation
+ * @return one tuple per group (see aggregate_vars)
+ * @throw std::invalid_argument if a variable of group_by is not in vars
+ * @throw std::overflow_error if a count or a sum does not fit in an int
+ */
+Relation<int> aggregate_groups(Relation<int>& rel, const std::vector<int>& vars, const GroupBy& group_by);
+
+/*
+ * Combines partial aggregates of the same groups, computed by
+ * aggregate_groups on parts of a relation, into those of the whole:
+ * counts and sums add up, minima and maxima are taken again.
+ *
+ * @param partials partial aggregates, in the layout of aggregate_groups (consumed)
+ * @param group_by aggregation
+ * @return one tuple per group, sorted on the group variables
+ */
+Relation<int> combine_groups(Relation<int>& partials, const GroupBy& group_by);
+
+#endif
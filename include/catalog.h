@@ -0,0 +1,113 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "csr.h"
+#include "relation.h"
+
+/*
+ * Relations read by this process (or thread), and the partitionings
+ * made of them, so that a file referenced several times by a query
+ * (self-joins) is parsed and divided only once. The entries last for
+ * one query (see CatalogScope).
+ *
+ * Entries are shared: callers copy them before handing them to an
+ * algorithm that consumes or reorders its input.
+ */
+class RelationCatalog {
+public:
+	/* divides a relation (without modifying it) into parts */
+	using divider_t = std::function<std::vector<Relation<int>>(Relation<int>&)>;
+
+	/*
+	 * Returns the relation stored in a file, reading it on first use
+	 *
+	 * @param filename name of the relation file
+	 */
+	Relation<int>& relation(const std::string& filename);
+
+	/*
+	 * Returns a partitioning of the relation stored in a file, made by
+	 * divide on first use. Two partitionings with the same key must be
+	 * equal: the key identifies the partitioning scheme, e.g. the
+	 * coordinates, hash function and number of parts.
+	 *
+	 * @param filename name of the relation file
+	 * @param key identifier of the partitioning scheme
+	 * @param divide function making the partitioning
+	 */
+	std::vector<Relation<int>>& partitioned(const std::string& filename,
+						const std::vector<int>& key,
+						const divider_t& divide);
+
+	/*
+	 * Returns the index of a binary relation file (see csr.h), mapped on
+	 * first use, and built first if it is missing or older than the file
+	 *
+	 * @param filename name of the relation file
+	 * @return the index, or nullptr if the relation is not binary
+	 */
+	const CsrIndex* index(const std::string& filename);
+
+	/* drops every entry */
+	void clear();
+
+private:
+	std::map<std::string, Relation<int>> relations;
+	std::map<std::tuple<std::string, std::vector<int>>, std::vector<Relation<int>>> partitions;
+	std::map<std::string, std::unique_ptr<CsrIndex>> indexes;
+};
+
+/*
+ * Returns the catalog of the calling thread
+ */
+RelationCatalog& relation_catalog();
+
+/*
+ * Scope of a query: the catalog of the calling thread is cleared when
+ * the outermost scope ends, so that the relations and partitionings of
+ * a query are not kept for the next ones
+ */
+class CatalogScope {
+public:
+	CatalogScope();
+	~CatalogScope();
+	CatalogScope(const CatalogScope&) = delete;
+	CatalogScope& operator=(const CatalogScope&) = delete;
+};
+
+/*
+ * Reads the relation stored in a file into rel, through the catalog
+ * when settings::cache_relations is on. With settings::csr_index, a
+ * binary relation comes from its index, already sorted.
+ *
+ * @param filename name of the relation file
+ * @param rel relation receiving the tuples (replaced)
+ */
+void load_relation(const std::string& filename, Relation<int>& rel);
+
+/*
+ * Reads the relation stored in a file and divides it, through the
+ * catalog when settings::cache_relations is on
+ *
+ * @param filename name of the relation file
+ * @param key identifier of the partitioning scheme (see RelationCatalog)
+ * @param divide function making the partitioning
+ * @return the parts (a copy, the caller may consume them)
+ */
+std::vector<Relation<int>> load_partitioned(const std::string& filename,
+					    const std::vector<int>& key,
+					    const RelationCatalog::divider_t& divide);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef COMMUNICATOR_H
+#define COMMUNICATOR_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "relation.h"
+
+enum class ReduceOp {Sum, Max};
+
+/*
+ * Group of processes executing a distributed algorithm together, and
+ * the collective operations the algorithms need. Every process of the
+ * group must call the same collective operations in the same order.
+ *
+ * Two implementations exist: one process per MPI rank (Boost.MPI), and
+ * one thread per rank inside a single process, where relations are
+ * handed over in shared memory instead of being copied.
+ */
+class Communicator {
+public:
+	virtual ~Communicator() {}
+
+	virtual int rank() const = 0;
+	virtual int size() const = 0;
+	virtual void barrier() = 0;
+
+	/*
+	 * Process i receives parts[i] of the root into part. The parts
+	 * may be consumed (left empty) by the operation.
+	 *
+	 * @return number of bytes this process put on the network
+	 */
+	virtual std::size_t scatter(std::vector<Relation<int>>& parts,
+				    Relation<int>& part, int root) = 0;
+
+	/*
+	 * The root receives into parts[i] the relation part of process i.
+	 * The part may be consumed (left empty) by the operation.
+	 *
+	 * @return number of bytes this process put on the network
+	 */
+	virtual std::size_t gather(Relation<int>& part,
+				   std::vector<Relation<int>>& parts, int root) = 0;
+
+	/*
+	 * Every process receives a copy of the relation rel of the root.
+	 *
+	 * @return number of bytes this process put on the network
+	 */
+	virtual std::size_t broadcast(Relation<int>& rel, int root) = 0;
+
+	virtual void broadcast(int& value, int root) = 0;
+	virtual void broadcast(std::vector<int>& values, int root) = 0;
+
+	/*
+	 * Combines coordinate by coordinate the vectors values of all
+	 * processes (which must have the same size). The result replaces
+	 * values on the root.
+	 */
+	virtual void reduce(std::vector<std::size_t>& values, ReduceOp op, int root) = 0;
+
+	/*
+	 * Point-to-point messages. Messages from one process to another
+	 * with the same tag are received in the order they were sent.
+	 * A relation sent may be consumed (left empty).
+	 *
+	 * @return (send) number of bytes put on the network
+	 * @return (recv of an int) the process that sent the message
+	 */
+	static const int any_source = -1;
+	virtual std::size_t send(Relation<int>& rel, int dest, int tag) = 0;
+	virtual void recv(Relation<int>& rel, int src, int tag) = 0;
+	virtual void send(int value, int dest, int tag) = 0;
+	virtual int recv(int& value, int src, int tag) = 0;
+
+	/* checks, without blocking, whether an int with this tag is waiting */
+	virtual bool probe(int tag) = 0;
+};
+
+/*
+ * Number of bytes taken by the tuples of rel as plain integers
+ */
+inline std::size_t wire_size(Relation<int>& rel)
+{
+	return rel.size() * rel.get_arity() * sizeof(int);
+}
+
+/*
+ * Returns the communicator of the calling thread: the one installed by
+ * run_on_threads, or else the MPI communicator of all ranks.
+ */
+Communicator& current_communicator();
+
+/*
+ * Runs body on nthreads threads of this process, each one seeing
+ * through current_communicator() a communicator of size nthreads
+ * whose ranks are the threads. Returns when every thread is done.
+ *
+ * @param nthreads number of threads (ranks)
+ * @param body function run by every thread
+ */
+void run_on_threads(int nthreads, const std::function<void()>& body);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstddef>
+#include <vector>
+#include <boost/serialization/vector.hpp>
+#include "relation.h"
+
+/*
+ * Compact wire format for a relation of integer tuples.
+ *
+ * The tuples are sorted lexicographically and written one after the
+ * other as variable-byte integers: the first coordinate is stored as
+ * the (non-negative) gap to the first coordinate of the previous tuple,
+ * every other coordinate as the zigzag-encoded difference to the same
+ * coordinate of the previous tuple. Clustered vertex ids thus take one
+ * or two bytes instead of four.
+ *
+ * The order of the tuples is not preserved, only the multiset.
+ */
+class CompressedRelation {
+private:
+	/* member variables */
+	std::size_t arity;
+	std::size_t count;
+	std::vector<unsigned char> data;
+
+	/* member private functions */
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive &ar, const unsigned int version) {
+		ar & arity;
+		ar & count;
+		ar & data;
+	}
+public:
+	/* constructors */
+	CompressedRelation() : arity{1}, count{0} {}
+
+	/*
+	 * Encodes rel. The relation itself is left untouched.
+	 *
+	 * @param rel relation to encode
+	 */
+	explicit CompressedRelation(Relation<int>& rel);
+
+	/* member public functions */
+	std::size_t size() const { return count; }
+	std::size_t get_arity() const { return arity; }
+	std::size_t raw_bytes() const { return count * arity * sizeof(int); }
+	std::size_t encoded_bytes() const { return data.size(); }
+
+	/*
+	 * Decodes the tuples and appends them to rel, whose arity
+	 * is set to the one of the encoded relation. The tuples come
+	 * out sorted on all columns, so an empty rel gets that order.
+	 *
+	 * @param rel relation receiving the tuples
+	 */
+	void decode(Relation<int>& rel) const;
+};
+
+#endif
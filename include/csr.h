@@ -0,0 +1,122 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef CSR_H
+#define CSR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "predicate.h"
+#include "relation.h"
+
+/*
+ * Compressed sparse row index of a binary relation (an edge list),
+ * stored on disk next to the relation file (see csr_file_name) and
+ * memory-mapped on load. It holds both directions: the forward one
+ * lists the tuples (u, v) by u, the backward one by v. A direction is
+ * the distinct keys in increasing order, the offsets of their runs, and
+ * the other column of the tuples of each run (the neighbors), sorted.
+ * Duplicate tuples are kept, like in the relation.
+ *
+ * The index is in the byte order of the machine that built it.
+ */
+class CsrIndex {
+public:
+	/*
+	 * Maps the index of a relation file
+	 *
+	 * @param filename name of the relation file (not of its index)
+	 * @throw std::runtime_error if the index cannot be read or is malformed
+	 */
+	explicit CsrIndex(const std::string& filename);
+	~CsrIndex();
+	CsrIndex(const CsrIndex&) = delete;
+	CsrIndex& operator=(const CsrIndex&) = delete;
+
+	/* number of tuples of the relation */
+	std::size_t size() const { return num_tuples; }
+
+	/*
+	 * Neighbors of a key, sorted
+	 *
+	 * @param key value of the first column (forward) or of the second one (backward)
+	 * @param backward direction of the lookup
+	 * @return the range [first, last) of the other column of the tuples with that key
+	 */
+	std::pair<const int*, const int*> neighbors(int key, bool backward) const;
+
+	/*
+	 * Tuples of the relation, already sorted: on (0, 1) if forward, on (1, 0) if backward
+	 */
+	Relation<int> relation(bool backward) const;
+
+private:
+	struct Direction {
+		std::size_t num_keys;
+		const std::uint64_t* offsets; // num_keys + 1 of them
+		const int* keys;
+		const int* neighbors;
+	};
+
+	void* data; // the mapping
+	std::size_t length;
+	std::size_t num_tuples;
+	Direction directions[2];
+};
+
+/*
+ * Name of the index file of a relation file
+ */
+std::string csr_file_name(const std::string& filename);
+
+/*
+ * Checks whether the index of a relation file exists and was written
+ * after the relation was last modified
+ */
+bool csr_index_current(const std::string& filename);
+
+/*
+ * Builds the index of a binary relation file. The index is written to
+ * a temporary file, then renamed, so that processes building the same
+ * index at once, or reading it meanwhile, never see a partial file.
+ *
+ * @param filename name of the relation file
+ * @throw std::invalid_argument if the relation is not binary
+ * @throw std::runtime_error if the index cannot be written
+ */
+void build_csr_index(const std::string& filename);
+
+/*
+ * Joins a relation with a binary relation through its index, without
+ * sorting either: for every tuple of rel1, the neighbors of the bound
+ * end of vars2 are looked up (if both ends are bound, the tuples equal
+ * to both). The result has the tuples, the order and the predicates of
+ * join(rel1, rel2, vars1, vars2), where rel2 holds the tuples of the
+ * index that satisfy the predicates bound by vars2.
+ *
+ * @param rel1 first relation
+ * @param index index of the second relation
+ * @param vars1 tuple of variables for first relation
+ * @param vars2 tuple of variables for second relation, one of them at
+ * 	  least in vars1
+ * @param limit the join stops once it has produced limit tuples (0: no limit)
+ * @param stopped if set, polled regularly; the join stops as soon as it returns true
+ * @param predicates predicates of the query
+ * @return result of join operation
+ */
+Relation<int> index_join(Relation<int>& rel1,
+			 const CsrIndex& index,
+			 const std::vector<int>& vars1,
+			 const std::vector<int>& vars2,
+			 std::size_t limit = 0,
+			 const std::function<bool()>& stopped = std::function<bool()>(),
+			 const std::vector<Predicate>& predicates = std::vector<Predicate>());
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef EXTERNAL_H
+#define EXTERNAL_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "predicate.h"
+#include "relation.h"
+
+/*
+ * Approximate number of bytes of memory taken by a relation
+ * (tuple objects plus their heap-allocated values)
+ *
+ * @param rel relation
+ * @return estimated memory footprint in bytes
+ */
+std::size_t memory_footprint(Relation<int>& rel);
+
+/*
+ * Performs join operation in two relations out of core: each relation
+ * is written to scratch files (settings::scratch_dir) as sorted runs
+ * small enough for the memory budget, and the runs are merged back
+ * while joining, in several passes if there are too many of them to
+ * merge at once. Files are read and written sequentially in blocks
+ * sized from the budget, and removed as soon as they are merged, or
+ * when an exception leaves the join.
+ *
+ * Both relations are emptied. Apart from the result, the join holds a
+ * block per merged run and part of the tuples of the second relation
+ * sharing a join key; larger groups of equal keys are spilled too. A
+ * budget under a few kilobytes is rounded up to the smallest block.
+ *
+ * @param rel1 first relation
+ * @param rel2 second relation
+ * @param vars1 tuple of variables for first relation
+ * @param vars2 tuple of variables for second relation
+ * @param budget memory budget in bytes
+ * @param limit the merge stops once limit tuples are produced (0: no limit)
+ * @param stopped if set, polled regularly during the merge; the join
+ * 	  stops as soon as it returns true
+ * @param predicates predicates of the query, evaluated as in join
+ * @return result of join operation
+ */
+Relation<int> external_join(Relation<int>& rel1,
+			    Relation<int>& rel2,
+			    const std::vector<int>& vars1,
+			    const std::vector<int>& vars2,
+			    std::size_t budget,
+			    std::size_t limit = 0,
+			    const std::function<bool()>& stopped = std::function<bool()>(),
+			    const std::vector<Predicate>& predicates = std::vector<Predicate>());
+
+#endif
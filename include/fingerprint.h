@@ -0,0 +1,53 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include "relation.h"
+
+/*
+ * Order-independent fingerprint of a multiset of tuples: their number
+ * and two sums (mod 2^64) of independent 64-bit hashes of the tuples.
+ * The fingerprint of a union of parts is the sum of the fingerprints
+ * of the parts, so a result spread over the processes is checked
+ * without bringing it anywhere; two different multisets get the same
+ * fingerprint with probability about 2^-128.
+ */
+struct Fingerprint {
+	std::size_t count;
+	std::uint64_t sum1;
+	std::uint64_t sum2;
+};
+
+/*
+ * Fingerprint of the tuples of a relation
+ *
+ * @param rel relation
+ */
+Fingerprint fingerprint(Relation<int>& rel);
+
+/*
+ * Fingerprint of the union of the parts of a relation held by the
+ * processes of current_communicator(), on the root.
+ * Must be called by every process.
+ *
+ * @param part part of this process
+ * @return the fingerprint of the whole relation (only on the root)
+ */
+Fingerprint distributed_fingerprint(Relation<int>& part);
+
+bool operator==(const Fingerprint& a, const Fingerprint& b);
+
+/* written as "<count> <sum1> <sum2>", the sums in hexadecimal */
+std::ostream& operator<<(std::ostream& os, const Fingerprint& fp);
+
+std::istream& operator>>(std::istream& is, Fingerprint& fp);
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include "relation.h"
+
+/*
+ * Synthetic undirected graphs, for benchmarks. A graph is a relation
+ * of arity 2 holding every edge in both directions, like the inputs of
+ * tests/triangles, without self-loops nor duplicate edges, sorted.
+ * The same seed gives the same graph.
+ */
+
+/*
+ * Uniform random graph G(n, m): m edges drawn uniformly among the
+ * pairs of vertices (fewer once duplicates are dropped)
+ *
+ * @param n number of vertices
+ * @param m number of edges drawn
+ * @param seed seed of the random generator
+ */
+Relation<int> erdos_renyi_graph(int n, std::size_t m, std::uint64_t seed);
+
+/*
+ * R-MAT (recursive matrix, the Kronecker generator of Graph500):
+ * each edge falls in one quadrant of the adjacency matrix, recursively,
+ * with probabilities a, b, c and 1 - a - b - c. The larger a, the more
+ * skewed the degrees (a = 0.25 gives a uniform graph, Graph500 uses
+ * a = 0.57, b = c = 0.19).
+ *
+ * @param scale the graph has 2^scale vertices
+ * @param m number of edges drawn
+ * @param a probability of the top left quadrant
+ * @param b probability of the top right quadrant
+ * @param c probability of the bottom left quadrant
+ * @param seed seed of the random generator
+ */
+Relation<int> rmat_graph(int scale, std::size_t m, double a, double b, double c, std::uint64_t seed);
+
+/*
+ * Barabási–Albert preferential attachment: starting from a clique of
+ * k + 1 vertices, every new vertex is linked to k distinct vertices
+ * chosen with probability proportional to their degree (power-law
+ * degrees of exponent 3)
+ *
+ * @param n number of vertices
+ * @param k edges of every new vertex
+ * @param seed seed of the random generator
+ */
+Relation<int> barabasi_albert_graph(int n, int k, std::uint64_t seed);
+
+#endif
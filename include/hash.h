@@ -7,31 +7,333 @@
 #ifndef HASH_CPP
 #define HASH_CPP
 
-#include <cmath>
-#include "MurmurHash3.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Hash functions are policy types: function objects mapping a key to
+ * a bucket in [0, size). Algorithms take them as template parameters,
+ * so the choice of hash function is made once per relation and the
+ * per-tuple call is inlined.
+ *
+ * Except ModHash, they map their 32-bit hash h to a bucket by
+ * multiply-high, (h * size) >> 32, rather than by h % size: no
+ * division, and the same operation in the vectorized hash_batch.
+ *
+ * Each one is a family indexed by a seed; seed 0 is the original
+ * function. Partitionings that must not be correlated (the dimensions
+ * of the hypercube, the rounds of the forwarding join) use different
+ * seeds, see derive_seed.
+ */
+
+/*
+ * Seed number index of a sequence of seeds starting from base
+ * (splitmix64 of both)
+ */
+inline std::uint32_t derive_seed(std::uint32_t base, unsigned index)
+{
+	std::uint64_t z = ((std::uint64_t) base << 32 | index) + 0x9e3779b97f4a7c15ull;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return (std::uint32_t) (z ^ (z >> 31));
+}
+
+/* bucket in [0, size) of a 32-bit hash, by multiply-high */
+inline unsigned reduce_range(std::uint32_t h, unsigned size)
+{
+	return (unsigned) (((std::uint64_t) h * size) >> 32);
+}
+
+/* key mod size; the seed is ignored, this is the identity partitioning */
+struct ModHash {
+	explicit ModHash(std::uint32_t = 0) {}
+
+	unsigned operator()(unsigned key, unsigned size) const
+	{
+		return key % size;
+	}
+};
+
+/*
+ * Knuth's multiplicative hashing floor(size * frac(key * A)) with
+ * A = (sqrt(5) - 1) / 2, computed in 32-bit fixed point: the product
+ * key * floor(A * 2^32) mod 2^32 is frac(key * A) scaled by 2^32.
+ * Other seeds take another odd multiplier (multiply-shift family).
+ */
+struct MultHash {
+	std::uint32_t multiplier;
+
+	explicit MultHash(std::uint32_t seed = 0)
+		: multiplier{seed ? (derive_seed(seed, 0) | 1u) : 2654435769u} {}
+
+	unsigned operator()(unsigned key, unsigned size) const
+	{
+		return reduce_range(key * multiplier, size);
+	}
+};
+
+/*
+ * MurmurHash3_x86_32 of the 4 bytes of the key, with the generic byte
+ * loop unrolled for a single block.
+ */
+struct MurmurHash {
+	std::uint32_t seed;
+
+	explicit MurmurHash(std::uint32_t s = 0) : seed{s} {}
+
+	static std::uint32_t rotl(std::uint32_t x, int r)
+	{
+		return (x << r) | (x >> (32 - r));
+	}
+
+	static std::uint32_t fmix(std::uint32_t h)
+	{
+		h ^= h >> 16;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35;
+		h ^= h >> 16;
+		return h;
+	}
+
+	unsigned operator()(unsigned key, unsigned size) const
+	{
+		std::uint32_t k = key * 0xcc9e2d51;
+		k = rotl(k, 15) * 0x1b873593;
+		std::uint32_t h = rotl(seed ^ k, 13) * 5 + 0xe6546b64;
+		return reduce_range(fmix(h ^ 4), size);
+	}
+};
+
+/*
+ * Simple tabulation hashing: the xor of one random table entry per
+ * byte of the key. 3-independent, and only four lookups per key.
+ * The seed selects the random tables.
+ */
+struct TabulationHash {
+	std::uint32_t table[4][256];
+
+	explicit TabulationHash(std::uint32_t seed = 0)
+	{
+		std::uint64_t state = 0x9e3779b97f4a7c15ull ^ seed; // xorshift64*
+		for (auto& row : table)
+			for (auto& entry : row) {
+				state ^= state >> 12;
+				state ^= state << 25;
+				state ^= state >> 27;
+				entry = (std::uint32_t) ((state * 0x2545f4914f6cdd1dull) >> 32);
+			}
+	}
+
+	unsigned operator()(unsigned key, unsigned size) const
+	{
+		return reduce_range(table[0][key & 0xff] ^ table[1][(key >> 8) & 0xff] ^
+				    table[2][(key >> 16) & 0xff] ^ table[3][key >> 24], size);
+	}
+};
+
+/*
+ * Hashes n keys at once: out[i] = hash(keys[i], size). The generic
+ * version is a loop over the keys; MultHash and MurmurHash have SIMD
+ * versions below, eight keys per instruction with AVX2 when the
+ * processor has it, else four with SSE2, the tail in scalar. ModHash
+ * divides and TabulationHash looks up tables, so they keep the loop.
+ *
+ * @param hash hash function
+ * @param keys array of n keys
+ * @param n number of keys
+ * @param size number of buckets
+ * @param out array of n buckets
+ */
+template<typename Hash>
+void hash_batch(const Hash& hash, const unsigned* keys, std::size_t n,
+		unsigned size, unsigned* out)
+{
+	for (std::size_t i = 0; i < n; i++)
+		out[i] = hash(keys[i], size);
+}
+
+#ifdef __SSE2__
+/* low 32 bits of the products of the lanes of a and b (SSE2 has no pmulld) */
+inline __m128i mullo_epu32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+				  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* high 32 bits of the products of the lanes of a and b: reduce_range of each lane */
+inline __m128i mulhi_epu32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_srli_epi64(_mm_mul_epu32(a, b), 32);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_or_si128(even, _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0)));
+}
+
+inline __m128i rotl_epi32(__m128i x, int r)
+{
+	return _mm_or_si128(_mm_slli_epi32(x, r), _mm_srli_epi32(x, 32 - r));
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HASH_BATCH_AVX2 1
+
+/*
+ * AVX2 versions of the batches, eight keys per instruction with a
+ * native 32-bit multiply. They are compiled for AVX2 whatever the
+ * flags of the build and only called when the processor has it.
+ */
+inline bool has_avx2()
+{
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+__attribute__((target("avx2")))
+inline __m256i mulhi_epu32_avx2(__m256i a, __m256i b)
+{
+	__m256i even = _mm256_srli_epi64(_mm256_mul_epu32(a, b), 32);
+	__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+	return _mm256_blend_epi32(even, odd, 0xaa);
+}
+
+__attribute__((target("avx2")))
+inline __m256i rotl_epi32_avx2(__m256i x, int r)
+{
+	return _mm256_or_si256(_mm256_slli_epi32(x, r), _mm256_srli_epi32(x, 32 - r));
+}
+
+__attribute__((target("avx2")))
+inline std::size_t hash_batch_avx2(const MultHash& hash, const unsigned* keys, std::size_t n,
+				   unsigned size, unsigned* out)
+{
+	const __m256i multiplier = _mm256_set1_epi32((int) hash.multiplier);
+	const __m256i buckets = _mm256_set1_epi32((int) size);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		__m256i frac = _mm256_mullo_epi32(k, multiplier);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), mulhi_epu32_avx2(frac, buckets));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+inline std::size_t hash_batch_avx2(const MurmurHash& hash, const unsigned* keys, std::size_t n,
+				   unsigned size, unsigned* out)
+{
+	const __m256i c1 = _mm256_set1_epi32((int) 0xcc9e2d51), c2 = _mm256_set1_epi32(0x1b873593);
+	const __m256i m1 = _mm256_set1_epi32((int) 0x85ebca6b), m2 = _mm256_set1_epi32((int) 0xc2b2ae35);
+	const __m256i seed = _mm256_set1_epi32((int) hash.seed);
+	const __m256i step = _mm256_set1_epi32((int) 0xe6546b64), length = _mm256_set1_epi32(4);
+	const __m256i buckets = _mm256_set1_epi32((int) size);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		k = _mm256_mullo_epi32(rotl_epi32_avx2(_mm256_mullo_epi32(k, c1), 15), c2);
+		__m256i h = rotl_epi32_avx2(_mm256_xor_si256(seed, k), 13);
+		h = _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(h, 2), h), step);
+		h = _mm256_xor_si256(h, length);
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+		h = _mm256_mullo_epi32(h, m1);
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+		h = _mm256_mullo_epi32(h, m2);
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), mulhi_epu32_avx2(h, buckets));
+	}
+	return i;
+}
+#endif
+
+inline void hash_batch(const MultHash& hash, const unsigned* keys, std::size_t n,
+		       unsigned size, unsigned* out)
+{
+	const __m128i multiplier = _mm_set1_epi32((int) hash.multiplier);
+	const __m128i buckets = _mm_set1_epi32((int) size);
+	std::size_t i = 0;
+#ifdef HASH_BATCH_AVX2
+	if (has_avx2())
+		i = hash_batch_avx2(hash, keys, n, size, out);
+#endif
+	for (; i + 4 <= n; i += 4) {
+		__m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+		__m128i frac = mullo_epu32(k, multiplier);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), mulhi_epu32(frac, buckets));
+	}
+	for (; i < n; i++)
+		out[i] = hash(keys[i], size);
+}
+
+inline void hash_batch(const MurmurHash& hash, const unsigned* keys, std::size_t n,
+		       unsigned size, unsigned* out)
+{
+	const __m128i c1 = _mm_set1_epi32((int) 0xcc9e2d51), c2 = _mm_set1_epi32(0x1b873593);
+	const __m128i m1 = _mm_set1_epi32((int) 0x85ebca6b), m2 = _mm_set1_epi32((int) 0xc2b2ae35);
+	const __m128i seed = _mm_set1_epi32((int) hash.seed);
+	const __m128i step = _mm_set1_epi32((int) 0xe6546b64), length = _mm_set1_epi32(4);
+	const __m128i buckets = _mm_set1_epi32((int) size);
+	std::size_t i = 0;
+#ifdef HASH_BATCH_AVX2
+	if (has_avx2())
+		i = hash_batch_avx2(hash, keys, n, size, out);
+#endif
+	for (; i + 4 <= n; i += 4) {
+		__m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+		k = mullo_epu32(rotl_epi32(mullo_epu32(k, c1), 15), c2);
+		__m128i h = rotl_epi32(_mm_xor_si128(seed, k), 13);
+		h = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(h, 2), h), step);
+		h = _mm_xor_si128(h, length);
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+		h = mullo_epu32(h, m1);
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 13));
+		h = mullo_epu32(h, m2);
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), mulhi_epu32(h, buckets));
+	}
+	for (; i < n; i++)
+		out[i] = hash(keys[i], size);
+}
+#endif
 
 inline unsigned mod_hash(unsigned key, unsigned size)
 {
-	return key % size;
+	return ModHash()(key, size);
 }
 
-inline unsigned mult_hash(unsigned key,
-		   unsigned size,
-		   double A = (std::sqrt(5) - 1)/2)
+inline unsigned mult_hash(unsigned key, unsigned size)
 {
-	double x = key * A;
-	x -= std::trunc(x);
-	x *= size;
-	
-	return (unsigned) std::trunc(x);
+	return MultHash()(key, size);
 }
 
 inline unsigned murmur_hash(unsigned key, unsigned size)
 {
-	unsigned result = 0;
-	MurmurHash3_x86_32(&key, sizeof key, 0, &result);
+	return MurmurHash()(key, size);
+}
+
+/*
+ * Folds the coordinates coords of a tuple into a single key, so that
+ * tuples can be partitioned on several variables at once. A key made
+ * of a single coordinate is the value itself.
+ *
+ * @param tpl tuple
+ * @param coords coordinates of tpl forming the key (non-empty)
+ * @return the combined key
+ */
+inline unsigned combine_keys(const std::vector<int>& tpl, const std::vector<int>& coords)
+{
+	unsigned key = tpl[coords[0]];
+	for (std::size_t i = 1; i < coords.size(); i++)
+		key ^= (unsigned) tpl[coords[i]] + 0x9e3779b9u + (key << 6) + (key >> 2);
 
-	return result % size;
+	return key;
 }
 
 #endif
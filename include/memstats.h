@@ -0,0 +1,61 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <cstddef>
+#include <iostream>
+
+/*
+ * Heap accounting. When settings::report_memory is on, every
+ * allocation through operator new (tuples, relations, serialization
+ * buffers) updates a byte counter of the process, and each thread
+ * records the highest value of the counter it saw during each phase
+ * of the algorithms.
+ *
+ * With the shared-memory backend (settings::threads) the counter is
+ * the one of the whole process, shared by all ranks.
+ */
+enum class Phase {Read, Partition, Shuffle, Sort, Join, Gather, Aggregate};
+const int NUM_PHASES = 7;
+
+/* name of a phase in the reports */
+const char* phase_name(Phase phase);
+
+/* bytes currently allocated by the process */
+std::size_t current_memory();
+
+/* highest value of current_memory() so far */
+std::size_t peak_memory();
+
+/*
+ * Marks a phase for the lifetime of the object: the high-water mark
+ * of the phase is the peak of the counter between construction and
+ * destruction. Phases may nest; the peak of an inner phase counts for
+ * the outer ones too.
+ */
+class MemoryPhase {
+private:
+	Phase phase;
+	std::size_t outer_peak; // peak of the enclosing phase so far
+public:
+	explicit MemoryPhase(Phase p);
+	~MemoryPhase();
+	MemoryPhase(const MemoryPhase&) = delete;
+	MemoryPhase& operator=(const MemoryPhase&) = delete;
+};
+
+/*
+ * Prints, on the root, the high-water mark of every phase for every
+ * process, and its maximum and average over the processes.
+ * Must be called by every process.
+ *
+ * @param os stream where the report is written
+ */
+void report_memory(std::ostream& os);
+
+#endif
@@ -8,6 +8,11 @@
 #define MPIUTIL_H
 
 #include <boost/mpi.hpp> 
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "aggregate.h"
+#include "predicate.h"
 #include "relation.h"
 
 namespace mpi = boost::mpi;
@@ -15,7 +20,85 @@ namespace constants{
 	const int NONE = -1; // signalize when there are no common variables
 	const int ROOT = 0; // signalize when there are no common variables
 }
-enum class HashMethod {ModHash, MultHash, MurmurHash};
+enum class HashMethod {ModHash, MultHash, MurmurHash, TabulationHash};
+
+/*
+ * The distributed algorithms below run on the processes of
+ * current_communicator() (see communicator.h): MPI ranks by default,
+ * or threads of one process when called from run_on_threads.
+ */
+
+/*
+ * Volume handed to the network by this process during one shuffle
+ * (scatter or gather of relations), and number of tuples it ended
+ * up with (and their size as plain integers). sent_bytes is smaller
+ * than raw_bytes when settings::compress_shuffles is on.
+ */
+struct ShuffleStats {
+	std::size_t tuples;
+	std::size_t raw_bytes;
+	std::size_t sent_bytes;
+	std::size_t received;
+	std::size_t received_bytes;
+};
+
+/*
+ * Returns the statistics of every shuffle this process (or thread,
+ * for the shared-memory backend) took part in, in execution order. All processes take part in the same
+ * shuffles, so the i-th entries of different processes describe
+ * the same shuffle.
+ */
+std::vector<ShuffleStats>& shuffle_log();
+
+/*
+ * Sums the shuffle statistics of all processes and prints, on the
+ * root, one line per shuffle with its compression ratio and the
+ * largest number of tuples received by a single process.
+ * Must be called by every process.
+ *
+ * @param os stream where the report is written
+ */
+void report_shuffles(std::ostream& os);
+
+/*
+ * Divides a relation into nparts relations by hashing the key of
+ * every tuple (the values at coords) with the given hash function
+ *
+ * @param rel relation to divide
+ * @param coords coordinates of the key; if empty, every tuple is
+ * 	  assigned to constants::ROOT
+ * @param hash_method hash function (see hash.h)
+ * @param nparts number of relations to produce
+ * @param seed seed of the hash function
+ * @return nparts relations whose concatenation is a permutation of rel
+ */
+std::vector<Relation<int>> divide_tuples(Relation<int> &rel, const std::vector<int>& coords, HashMethod hash_method,
+					 int nparts, std::uint32_t seed);
+
+/*
+ * Divides the number of processes into num_vars factors as close as
+ * possible: the sides of the hypercube of processes
+ *
+ * @param num_procs number of processes
+ * @param num_vars number of distinct variables of the multiway join
+ * @return vector of factors
+ */
+std::vector<int> equally_factorize(int num_procs, int num_vars);
+
+/*
+ * Sends every tuple of rel to the processes of the hypercube whose
+ * address agrees with the hashes of its values: one coordinate per
+ * variable of the relation, every coordinate of the other variables
+ *
+ * @param rel relation to divide
+ * @param divided_rel one relation per process, where the tuples are added
+ * @param vars variables of rel
+ * @param address_limits sides of the hypercube (see equally_factorize)
+ * @param hash_method hash function (see hash.h)
+ * @param seed seed of the hash functions; each dimension derives its own from it
+ */
+void hypercube_divide_tuples(Relation<int>& rel, std::vector<Relation<int>>& divided_rel,
+	std::vector<int>& vars, std::vector<int>& address_limits, HashMethod hash_method, std::uint32_t seed);
 
 /* Performs join operation in a distributed fashion
  * using Boost's MPI interface.
@@ -25,43 +108,74 @@ enum class HashMethod {ModHash, MultHash, MurmurHash};
  * @param vars1 tuple of variables for first relation
  * @param vars2 tuple of variables for second relation
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are returned (0: all of them)
+ * @param predicates predicates of the query; the joins evaluate the ones
+ * 	  they bind (the inputs are assumed to satisfy their own)
  * @return result of join operation
  */
 Relation<int> distributed_join(Relation<int> &rel1,
 		      Relation<int> &rel2,
 		      std::vector<int> &vars1,
-		      std::vector<int> &vars2, HashMethod hash_method=HashMethod::ModHash);
+		      std::vector<int> &vars2, HashMethod hash_method=HashMethod::ModHash,
+		      std::size_t limit=0, const std::vector<Predicate>& predicates=std::vector<Predicate>());
 
 /*
  * Performs join operation for multiple relations
  * in a distributed fashion using Boost's MPI
- * implementation
+ * implementation. With settings::distinct_result, the duplicates
+ * of the result are eliminated by a shuffle on the whole tuples.
  *
  * @param rel_namesv vector containing relations' filenames
  * @param varsv vector of corresponding variables
  * @param result_vars vector to identify variables in the resulting relation
  * @param forward flag to enable auto-forward optimization
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are computed (0: all of them); the
+ * 	  processes stop as soon as one of them found enough, so limit 1
+ * 	  answers whether the pattern exists
+ * @param predicates selection predicates, evaluated as soon as their
+ * 	  variables are bound (see predicate.h)
+ * @param group_by aggregation of the result (see aggregate.h), computed
+ * 	  where the result is and combined by group; the limit then
+ * 	  applies to the groups
+ * @param output_vars variables of the result, in this order (empty: all
+ * 	  of them); the others are dropped as soon as no join, predicate or
+ * 	  aggregation needs them, so that fewer columns are shuffled
  * @return result of join operation as a new relation
  */
 Relation<int> distributed_multiway_join(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars, bool forward=true, HashMethod hash_method=HashMethod::ModHash);
+		   std::vector<int>& result_vars, bool forward=true, HashMethod hash_method=HashMethod::ModHash,
+		   std::size_t limit=0, const std::vector<Predicate>& predicates=std::vector<Predicate>(),
+		   const GroupBy& group_by=GroupBy(), const std::vector<int>& output_vars=std::vector<int>());
 
 /*
  * Performs join operation for multiple relations
  * in a distributed fashion using Boost's MPI
- * implementation, by applying the hypercube algorithm
+ * implementation, by applying the hypercube algorithm. With
+ * settings::distinct_result, the duplicates of the result are
+ * eliminated like in distributed_multiway_join.
  *
  * @param rel_namesv vector containing relations' filenames
  * @param varsv vector of corresponding variables
  * @param result_vars vector to identify variables in the resulting relation
  * @param forward flag to enable auto-forward optimization
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are computed (0: all of them)
+ * @param predicates selection predicates, evaluated as soon as their
+ * 	  variables are bound (see predicate.h)
+ * @param group_by aggregation of the result (see aggregate.h), computed
+ * 	  where the result is and combined by group; the limit then
+ * 	  applies to the groups
+ * @param output_vars variables of the result, in this order (empty: all
+ * 	  of them); the others are dropped as soon as no join, predicate or
+ * 	  aggregation needs them, so that fewer columns are shuffled
  * @return result of join operation as a new relation
  */
 Relation<int> hypercube_distributed_multiway_join(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars, HashMethod hash_method=HashMethod::ModHash);
+		   std::vector<int>& result_vars, HashMethod hash_method=HashMethod::ModHash,
+		   std::size_t limit=0, const std::vector<Predicate>& predicates=std::vector<Predicate>(),
+		   const GroupBy& group_by=GroupBy(), const std::vector<int>& output_vars=std::vector<int>());
 
 #endif
@@ -0,0 +1,131 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <string>
+#include <vector>
+#include "relation.h"
+
+enum class CompareOp {Eq, Ne, Lt, Le, Gt, Ge};
+
+/*
+ * Selection predicate of a query: "var op rhs", where rhs is another
+ * variable or a constant. Predicates are evaluated as early as their
+ * variables are bound: when a relation is read, if it binds all of
+ * them, or else by the first join that binds them.
+ */
+struct Predicate {
+	int var;
+	CompareOp op;
+	bool constant; // whether rhs is a constant rather than a variable
+	int rhs;
+};
+
+/*
+ * Parses a predicate of a query file, e.g. "0 < 1" or "2 != #5"
+ * (constants are written with a leading #)
+ *
+ * @param lhs variable
+ * @param op one of =, !=, <, <=, >, >=
+ * @param rhs variable, or constant
+ * @throw std::invalid_argument if a token is malformed
+ */
+Predicate parse_predicate(const std::string& lhs, const std::string& op, const std::string& rhs);
+
+/*
+ * Checks that the variables of every predicate are bound by a relation
+ * of the query: a predicate on another variable would never be
+ * evaluated, and the query would run unfiltered
+ *
+ * @param predicates predicates of the query
+ * @param varsv variables of the relations of the query
+ * @throw std::invalid_argument if a predicate has an unknown variable
+ */
+void check_predicates(const std::vector<Predicate>& predicates,
+		      const std::vector<std::vector<int>>& varsv);
+
+/*
+ * Returns the predicates whose variables all appear in vars
+ */
+std::vector<Predicate> bound_predicates(const std::vector<Predicate>& predicates,
+					const std::vector<int>& vars);
+
+/*
+ * Returns the predicates bound by the variables of a join result, but
+ * by neither of its inputs alone: the ones the join must evaluate
+ *
+ * @param predicates predicates of the query
+ * @param vars1 variables of the first input
+ * @param vars2 variables of the second input
+ * @param unique_vars variables of the result
+ */
+std::vector<Predicate> join_predicates(const std::vector<Predicate>& predicates,
+				       const std::vector<int>& vars1,
+				       const std::vector<int>& vars2,
+				       const std::vector<int>& unique_vars);
+
+/*
+ * Predicates bound by the variables of a tuple, compiled to the
+ * coordinates of those variables
+ */
+class Selection {
+private:
+	struct Test {
+		int coord;
+		CompareOp op;
+		int rhs_coord; // -1: compare to value
+		int value;
+	};
+	std::vector<Test> tests;
+
+	static bool compare(int a, CompareOp op, int b)
+	{
+		switch (op) {
+		case CompareOp::Eq: return a == b;
+		case CompareOp::Ne: return a != b;
+		case CompareOp::Lt: return a < b;
+		case CompareOp::Le: return a <= b;
+		case CompareOp::Gt: return a > b;
+		default: return a >= b;
+		}
+	}
+public:
+	/*
+	 * @param predicates predicates to evaluate (all bound by vars)
+	 * @param vars variables of the tuples
+	 */
+	Selection(const std::vector<Predicate>& predicates, const std::vector<int>& vars);
+
+	bool empty() const { return tests.empty(); }
+
+	/* the tests as integers, to tell apart in the relation catalog the partitionings of a file selected differently */
+	std::vector<int> key() const;
+
+	/* checks whether a tuple satisfies every predicate */
+	bool operator()(const Relation<int>::tuple_t& tpl) const
+	{
+		for (auto& test : tests)
+			if (!compare(tpl[test.coord], test.op,
+				     test.rhs_coord < 0 ? test.value : tpl[test.rhs_coord]))
+				return false;
+		return true;
+	}
+};
+
+/*
+ * Removes from a relation the tuples that do not satisfy the
+ * predicates bound by its variables. The order is kept.
+ *
+ * @param rel relation
+ * @param vars variables of the relation
+ * @param predicates predicates of the query
+ */
+void select_tuples(Relation<int>& rel, const std::vector<int>& vars,
+		   const std::vector<Predicate>& predicates);
+
+#endif
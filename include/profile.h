@@ -0,0 +1,60 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include "memstats.h"
+
+/*
+ * Time and volume accounting of the algorithms. Each thread adds up
+ * the time it spends in every phase (see memstats.h) and the sizes of
+ * the local joins it computes; the shuffles are logged by mpiutil
+ * (see shuffle_log). report_profile puts everything together as JSON.
+ */
+
+/*
+ * Marks a phase for the lifetime of the object, for memory accounting
+ * (see MemoryPhase) and for timing. The time of a phase excludes the
+ * phases nested in it: the sort of a join counts for Phase::Sort only.
+ */
+class PhaseScope {
+private:
+	MemoryPhase memory;
+	Phase phase;
+	PhaseScope* outer; // enclosing phase, paused meanwhile
+	std::chrono::steady_clock::time_point start;
+public:
+	explicit PhaseScope(Phase p);
+	~PhaseScope();
+	PhaseScope(const PhaseScope&) = delete;
+	PhaseScope& operator=(const PhaseScope&) = delete;
+};
+
+/*
+ * Records a local join computed by this thread
+ *
+ * @param input1 size of the first relation
+ * @param input2 size of the second relation
+ * @param output size of the result
+ */
+void record_join(std::size_t input1, std::size_t input2, std::size_t output);
+
+/*
+ * Writes, on the root, a JSON object with the minimum, maximum and
+ * average over the processes, and the value of each process, of:
+ * the time of every phase (seconds), the number and sizes of the local
+ * joins, and the volume of every shuffle (see ShuffleStats).
+ * Must be called by every process.
+ *
+ * @param os stream where the report is written
+ */
+void report_profile(std::ostream& os);
+
+#endif
@@ -7,44 +7,103 @@
 #ifndef RELATION_H
 #define RELATION_H
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <vector>
 #include <stdexcept>
 #include <boost/serialization/vector.hpp>
 
+/*
+ * The tuples are stored in chunks, each one a vector of tuples, so
+ * that concatenating two relations moves chunks instead of tuples.
+ * Iterators go through the chunks in order, skipping empty ones; code
+ * that needs random access (sorting) calls flatten first.
+ */
 template<typename T>
 class Relation {
 public:
 	using tuple_t = std::vector<T>;
 	using value_type = T;
+	using tuples_t = typename std::vector<tuple_t>;
 private:
 	/* private typenames */
-	using tuples_t = typename std::vector<tuple_t>;
+	using chunks_t = typename std::vector<tuples_t>;
 
 	/* member variables */
 	std::size_t arity;
-	tuples_t tuples; 
+	chunks_t chunks;
+	std::size_t count; // number of tuples in all chunks
+	std::vector<int> order; // columns the tuples are sorted by, lexicographically (empty: unknown)
 
 	/* member private functions */
 	friend class boost::serialization::access;
 	template<class Archive>
 	void serialize(Archive &ar, const unsigned int version) {
-		ar & tuples;
+		ar & chunks;
+		ar & count;
 		ar & arity;
+		ar & order;
 	}
 public:
 	/* public typenames */
-	using iterator = typename tuples_t::iterator;
+	class iterator {
+	private:
+		typename chunks_t::iterator chunk, last;
+		typename tuples_t::iterator pos;
+
+		/* moves on to the next tuple if the current chunk is exhausted */
+		void skip_empty()
+		{
+			while (chunk != last && pos == chunk->end())
+				if (++chunk != last)
+					pos = chunk->begin();
+		}
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = tuple_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = tuple_t*;
+		using reference = tuple_t&;
+
+		iterator() {}
+		iterator(typename chunks_t::iterator c, typename chunks_t::iterator l)
+			: chunk{c}, last{l}
+		{
+			if (chunk != last) {
+				pos = chunk->begin();
+				skip_empty();
+			}
+		}
+
+		reference operator*() const { return *pos; }
+		pointer operator->() const { return &*pos; }
+
+		iterator& operator++()
+		{
+			++pos;
+			skip_empty();
+			return *this;
+		}
+		iterator operator++(int) { iterator it = *this; ++*this; return it; }
+
+		bool operator==(const iterator& it) const
+		{
+			return chunk == it.chunk && (chunk == last || pos == it.pos);
+		}
+		bool operator!=(const iterator& it) const { return !(*this == it); }
+	};
 
 	/* constructors */	
-	Relation(std::size_t n = 1) : arity{n} {
+	Relation(std::size_t n = 1) : arity{n}, count{0} {
 		if (n <= 0) throw std::invalid_argument("arity should be\
 				positive integer"); }
 
 	/* copy constructor */
-	Relation(const Relation &rel) : arity{rel.arity}, tuples{rel.tuples} {}
+	Relation(const Relation &rel) : arity{rel.arity}, chunks{rel.chunks}, count{rel.count}, order{rel.order} {}
 
 	/* move constructor */
-	Relation(Relation &&rel) : arity{rel.arity}, tuples{std::move(rel.tuples)} {rel.arity = 0; rel.tuples.clear();}
+	Relation(Relation &&rel) : arity{rel.arity}, chunks{std::move(rel.chunks)}, count{rel.count}, order{std::move(rel.order)} {rel.arity = 0; rel.clear();}
 
 	/* copy assignment */
 	Relation& operator=(const Relation &rel);
@@ -54,14 +113,52 @@ public:
 	/* destructors */
 
 	/* member public functions */
-	std::size_t size() const { return tuples.size(); }
+	std::size_t size() const { return count; }
 	std::size_t get_arity() const { return arity; }
 	void set_arity(int arity) { this->arity = arity; }
-	iterator begin() { return tuples.begin(); }
-	iterator end() { return tuples.end(); }
-	void clear() { tuples.clear(); }
+	iterator begin() { return iterator(chunks.begin(), chunks.end()); }
+	iterator end() { return iterator(chunks.end(), chunks.end()); }
+	void clear() { chunks.clear(); count = 0; order.clear(); }
 
-	void push_tuple(tuple_t tpl) { tuples.push_back(tpl); }
+	/* appending a tuple forgets the order; whoever keeps it sets it again */
+	void push_tuple(tuple_t tpl)
+	{
+		if (chunks.empty())
+			chunks.emplace_back();
+		chunks.back().push_back(std::move(tpl));
+		count++;
+		order.clear();
+	}
+
+	/* last tuple (the relation must not be empty) */
+	tuple_t& back()
+	{
+		auto chunk = chunks.rbegin();
+		while (chunk->empty())
+			chunk++;
+		return chunk->back();
+	}
+
+	/* moves every tuple into a single chunk, and returns it */
+	tuples_t& flatten();
+
+	/* keeps the first n tuples only */
+	void truncate(std::size_t n);
+
+	/*
+	 * Order of the tuples: they are sorted lexicographically on these
+	 * columns. Whoever reorders or modifies tuples through the
+	 * iterators must update it.
+	 */
+	const std::vector<int>& get_order() const { return order; }
+	void set_order(const std::vector<int>& cols) { order = cols; }
+
+	/* checks whether the tuples are sorted on cols, i.e. cols is a prefix of the order */
+	bool sorted_on(const std::vector<int>& cols) const
+	{
+		return cols.size() <= order.size() &&
+			std::equal(cols.begin(), cols.end(), order.begin());
+	}
 
 	Relation<T>& concatenate(Relation<T> &rel);
 };
@@ -73,7 +170,9 @@ Relation<T>& Relation<T>::operator=(const Relation &rel) {
 		return *this;
 
 	arity = rel.arity;
-	tuples = rel.tuples;
+	chunks = rel.chunks;
+	count = rel.count;
+	order = rel.order;
 
 	return *this;
 }
@@ -85,20 +184,78 @@ Relation<T>& Relation<T>::operator=(Relation &&rel) {
 		return *this;
 
 	arity = rel.arity;
-	tuples = std::move(rel.tuples);
+	chunks = std::move(rel.chunks);
+	count = rel.count;
+	order = std::move(rel.order);
 
 	rel.arity = 0;
-	rel.tuples.clear();
+	rel.clear();
 
 	return *this;
 }
 
+template<typename T>
+typename Relation<T>::tuples_t& Relation<T>::flatten()
+{
+	if (chunks.empty())
+		chunks.emplace_back();
+	if (chunks.size() > 1) {
+		auto& first = chunks.front();
+		first.reserve(count);
+		for (auto it = chunks.begin() + 1; it != chunks.end(); it++)
+			first.insert(first.end(), std::make_move_iterator(it->begin()),
+				     std::make_move_iterator(it->end()));
+		chunks.resize(1);
+	}
+
+	return chunks.front();
+}
+
+template<typename T>
+void Relation<T>::truncate(std::size_t n)
+{
+	if (n >= count)
+		return;
+
+	std::size_t kept = 0;
+	auto chunk = chunks.begin();
+	for (; kept + chunk->size() < n; chunk++)
+		kept += chunk->size();
+	chunk->resize(n - kept);
+	chunks.erase(chunk + 1, chunks.end());
+	count = n;
+}
+
+/*
+ * Appends the tuples of rel, which is left empty. Its chunks are moved,
+ * not its tuples. The order is kept if both relations have the same
+ * one and the tuples still follow it where they meet.
+ */
 template<typename T>
 Relation<T>& Relation<T>::concatenate(Relation<T> &rel)
 {
-	tuples.insert(begin(),
-	              rel.begin(),
-	              rel.end());
+	if (rel.size() == 0)
+		return *this;
+	if (size() == 0)
+		return *this = std::move(rel);
+
+	bool keep_order = (order == rel.order);
+	if (keep_order) {
+		const tuple_t& A = back();
+		const tuple_t& B = *rel.begin();
+		for (int i : order) {
+			if (A[i] < B[i])	break;
+			else if (A[i] > B[i]) {	keep_order = false; break; }
+		}
+	}
+
+	chunks.insert(chunks.end(), std::make_move_iterator(rel.chunks.begin()),
+		      std::make_move_iterator(rel.chunks.end()));
+	count += rel.count;
+	if (!keep_order)
+		order.clear();
+	rel.clear();
+
 	return *this;
 }
 #endif
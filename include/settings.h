@@ -0,0 +1,54 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Run-time knobs shared by every algorithm. They are plain globals
+ * so the algorithms keep their signatures; the test drivers set
+ * them from "--name[=value]" command line flags.
+ */
+namespace settings {
+	extern bool compress_shuffles; // encode relations before sending them
+	extern bool report_shuffles; // print the statistics of every shuffle
+	extern int threads; // run the distributed algorithms on this many threads instead of MPI ranks (0: MPI)
+	extern double broadcast_threshold; // replicate a relation if nprocs * its size < threshold * other size (0: never)
+	extern unsigned hash_seed; // seed of the hash functions, from which the dimensions and rounds derive theirs
+	extern bool range_partition; // partition on ranges of the join key (sample sort) instead of hashing it
+	extern int overpartition; // virtual partitions per process in distributed_join (1: one, static)
+	extern std::size_t memory_budget; // bytes a local join may use before spilling to disk (0: unlimited)
+	extern std::string scratch_dir; // directory of the spilled files
+	extern bool report_memory; // count heap allocations and print the high-water mark of every phase
+	extern bool cache_relations; // parse and partition each relation file once per query (see catalog.h)
+	extern std::size_t result_limit; // number of result tuples the test drivers ask for (0: all)
+	extern bool report_profile; // print the time of every phase and the volume of every shuffle as JSON
+	extern std::string profile_file; // file of that report (empty: standard output)
+	extern bool gather_result; // gather the result of the distributed algorithms on the root (else each process keeps its part)
+	extern bool check_fingerprint; // the test drivers check the fingerprint of the result (see fingerprint.h) instead of its tuples
+	extern std::string fingerprint_file; // file of the reference fingerprint, written if missing (empty: that of the answer file)
+	extern bool distinct_result; // eliminate the duplicate tuples of the result (set semantics)
+	extern bool distinct_inputs; // eliminate the duplicate tuples of every relation file when it is read
+	extern bool csr_index; // load binary relations from their CSR index (see csr.h), built if missing, and probe it in the sequential join
+	extern bool packed_keys; // local joins on keys of at most two columns sort and merge them packed in a 64-bit word
+}
+
+/*
+ * Consumes every "--name[=value]" flag in argv, updating the
+ * corresponding setting, and compacts the remaining positional
+ * arguments to the front of argv.
+ *
+ * @param argc number of arguments, updated to the number of
+ * 	positional arguments left
+ * @param argv arguments
+ * @throw std::invalid_argument if a flag is unknown or malformed
+ */
+void parse_settings(int& argc, char* argv[]);
+
+#endif
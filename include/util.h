@@ -8,13 +8,17 @@
 #define UTIL_H
 
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <vector>
 #include <unordered_set>
+#include "aggregate.h"
+#include "predicate.h"
 #include "relation.h"
 
 /* 
- * Sorts a relation according to the order prescribed by perm
+ * Sorts a relation according to the order prescribed by perm,
+ * unless it is already sorted that way (see Relation::get_order)
  *
  * @param rel relation to sort
  * @param perm permutation of the set {0, ..., rel.arity() -1}
@@ -24,7 +28,11 @@
 template<typename T>
 void sort(Relation<T>& rel, const std::vector<int> perm)
 {
-	std::sort(rel.begin(), rel.end(),
+	if (rel.sorted_on(perm))
+		return;
+
+	auto& tuples = rel.flatten();
+	std::sort(tuples.begin(), tuples.end(),
 	[perm](const typename Relation<T>::tuple_t& A,
 	       const typename Relation<T>::tuple_t& B) {
 		for (int i : perm) {
@@ -32,6 +40,7 @@ void sort(Relation<T>& rel, const std::vector<int> perm)
 			else if (A[i] > B[i])	return false;
 		}
 		return false; });
+	rel.set_order(perm);
 }
 
 /*
@@ -89,32 +98,185 @@ std::vector<int> get_perm(const std::vector<int>& var_vect,
 std::vector<int> get_unique_vars(const std::vector<int>& vars1,
 				 const std::vector<int>& vars2);
 
+/*
+ * Returns a vector that maps each index i in common_vars
+ * to an index j in vars such that these indexes represent the 
+ * same symbolic variable
+ *
+ * @param vars vector containing a set of variables
+ * @param common_vars vector containing a subset of variables of vars
+ * @return a mapping from each index in common_vars to a index in
+ * 	in vars representing the same variable
+ */
+std::vector<int> index_common_variables(const std::vector<int>& vars,
+					const std::vector<int>& common_vars);
+
+/*
+ * Compares assignments of two tuples based on the order given by the
+ * matching vectors (see util.cpp).
+ *
+ * @return 0 if equal, 1 if tpl1 is greater, -1 if tpl1 is smaller
+ */
+int compare_assignments(const std::vector<int>& tpl1, const std::vector<int>& matching1,
+		const std::vector<int>& tpl2, const std::vector<int>& matching2);
+
+/*
+ * Checks if an assignment to a tuple is consistent with the assignment of
+ * variables, i.e. positions holding the same variable hold the same value.
+ *
+ * @param tpl assignment of values to variables in vars
+ * @param vars variables
+ * @return true if the assignment tpl is consistent with variables in vars
+ */
+bool consistent(const std::vector<int>& tpl, const std::vector<int>& vars);
+
+/*
+ * Merge two tuples of assignments based on the variables associated
+ * with each one.
+ *
+ * @param tpl1 first tuple of assignment
+ * @param tpl2 second tuple of assignment
+ * @param vars1 variables associated with first tuple
+ * @param vars2 variables associated with second tuple
+ * @param unique_vars sorted union of vars1 and vars2
+ * @return a tuple containing assignments to the variables in
+ * 	unique_vars in the same order
+ */
+std::vector<int> merge_reduce_tpls(const std::vector<int>& tpl1,
+				   const std::vector<int>& tpl2,
+				   const std::vector<int>& vars1,
+				   const std::vector<int>& vars2,
+				   const std::vector<int>& unique_vars);
+
+/*
+ * Order of the result of a join whose first relation was sorted on
+ * the columns order1: the tuples of the result come out in the order
+ * of the first relation.
+ *
+ * @param order1 columns the first relation is sorted by
+ * @param vars1 tuple of variables for first relation
+ * @param unique_vars variables of the result (see get_unique_vars)
+ * @return columns of the result it is sorted by
+ */
+std::vector<int> join_output_order(const std::vector<int>& order1,
+				   const std::vector<int>& vars1,
+				   const std::vector<int>& unique_vars);
+
+/*
+ * Merges relations into one. If they are all sorted on the same
+ * columns, they are merged k-way so that the result is sorted too
+ * (or just concatenated, if each one starts after the previous one
+ * ends); otherwise they are concatenated.
+ *
+ * @param parts relations to merge (consumed)
+ * @return the merged relation
+ */
+Relation<int> merge_sorted(std::vector<Relation<int>>& parts);
+
 /*
  * Performs join operation in two relations.
+ * A relation already sorted on the join key (see Relation::get_order)
+ * is not sorted again, and the result is sorted like the first one.
+ * If settings::memory_budget is set and the two relations take more
+ * memory than the budget, the join is computed out of core (see
+ * external.h).
  *
  * @param rel1 first relation
  * @param rel2 second relation
  * @param var1 tuple of variables for first relation
  * @param var2 tuple of variables for second relation
+ * @param limit the join stops once it has produced limit tuples (0: no limit)
+ * @param stopped if set, polled from time to time; the join stops as
+ * 	  soon as it returns true (another process found enough tuples)
+ * @param predicates predicates of the query; the join evaluates the ones
+ * 	  it binds (the inputs are assumed to satisfy their own)
  * @return result of join operation as a new relation
  */
 Relation<int> join(Relation<int>& rel1,
 		   Relation<int>& rel2,
 		   const std::vector<int>& var1,
-     		   const std::vector<int>& var2);
+     		   const std::vector<int>& var2,
+		   std::size_t limit = 0,
+		   const std::function<bool()>& stopped = std::function<bool()>(),
+		   const std::vector<Predicate>& predicates = std::vector<Predicate>());
+
+
+/*
+ * Returns the variables of the relations varsv[first..], without
+ * repetition: those still to be joined
+ */
+std::vector<int> remaining_vars(const std::vector<std::vector<int>>& varsv, std::size_t first);
+
+/*
+ * Variables a relation of a query must keep: those needed by the
+ * relations it is still to be joined with, by the output, by the
+ * aggregation, or by a predicate it does not bind (the ones it binds
+ * were evaluated). Without output variables nor aggregation, the
+ * query keeps every variable.
+ *
+ * @param vars variables of the relation
+ * @param later_vars variables of the relations it is still to be joined with
+ * @param output_vars output variables of the query (empty: all of them)
+ * @param predicates predicates of the query
+ * @param group_by aggregation of the query
+ * @return the variables of vars to keep, in their order, each one once
+ * 	   (at least one)
+ */
+std::vector<int> live_vars(const std::vector<int>& vars, const std::vector<int>& later_vars,
+			   const std::vector<int>& output_vars, const std::vector<Predicate>& predicates,
+			   const GroupBy& group_by);
+
+/*
+ * Keeps some columns of a relation only, in place. Duplicates are
+ * kept: each tuple keeps its multiplicity. If a variable is repeated in
+ * vars, the tuples whose copies of it differ are dropped first, since
+ * no join could check them afterwards. The relation stays sorted
+ * on the longest prefix of its order made of kept columns.
+ *
+ * @param rel relation
+ * @param vars variables of rel
+ * @param keep variables to keep, all in vars, in the order of the result
+ * @throw std::invalid_argument if a variable of keep is not in vars
+ */
+void project(Relation<int>& rel, const std::vector<int>& vars, const std::vector<int>& keep);
 
+/*
+ * Eliminates the duplicate tuples of a relation, in place: a sort on
+ * every column, unless its order already makes equal tuples adjacent,
+ * then a scan keeping the first tuple of every run. The order is kept.
+ *
+ * @param rel relation
+ */
+void distinct(Relation<int>& rel);
 
 /*
- * Performs join operation for multiple relations.
+ * Performs join operation for multiple relations. With
+ * settings::distinct_result, the duplicates of the result are
+ * eliminated, and the limit applies to the distinct tuples. With
+ * settings::csr_index, a binary relation sharing a variable with the
+ * partial result is probed through its index (see index_join) instead
+ * of being sorted and merged.
  *
  * @param relv 			vector containing names of relation files
  * @param varsv 		vector of corresponding variables
  * @param result_vars 	vector to identify variables in the resulting relation
+ * @param limit 		at most limit tuples are computed (0: all of them);
+ * 				limit 1 answers whether the pattern exists
+ * @param predicates 	selection predicates, evaluated as soon as their
+ * 				variables are bound (see predicate.h)
+ * @param group_by 	aggregation of the result (see aggregate.h); the
+ * 				limit then applies to the groups
+ * @param output_vars 	variables of the result, in this order (empty: all
+ * 				of them); the others are dropped as soon as no
+ * 				join, predicate or aggregation needs them
  * @return 				result of join operation as a new relation
  */
 Relation<int> multiway_join(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars);
+		   std::vector<int>& result_vars, std::size_t limit = 0,
+		   const std::vector<Predicate>& predicates = std::vector<Predicate>(),
+		   const GroupBy& group_by = GroupBy(),
+		   const std::vector<int>& output_vars = std::vector<int>());
 
 
 
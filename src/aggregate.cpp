@@ -0,0 +1,147 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include "aggregate.h"
+#include "profile.h"
+#include "util.h"
+
+Aggregate parse_aggregate(const std::string& op, int var)
+{
+	if (op == "count")	return Aggregate{AggregateOp::Count, var};
+	if (op == "sum")	return Aggregate{AggregateOp::Sum, var};
+	if (op == "min")	return Aggregate{AggregateOp::Min, var};
+	if (op == "max")	return Aggregate{AggregateOp::Max, var};
+	throw std::invalid_argument("invalid aggregate: " + op);
+}
+
+std::vector<int> aggregate_vars(const GroupBy& group_by, const std::vector<int>& vars)
+{
+	std::vector<int> result = group_by.group_vars;
+	int next = vars.empty() ? 0 : *std::max_element(vars.begin(), vars.end()) + 1;
+	for (std::size_t i = 0; i < group_by.aggregates.size(); i++)
+		result.push_back(next + i);
+
+	return result;
+}
+
+/*
+ * Returns the coordinate of var in vars
+ */
+static int coord_of(const std::vector<int>& vars, int var)
+{
+	auto it = std::find(vars.begin(), vars.end(), var);
+	if (it == vars.end())
+		throw std::invalid_argument("aggregation on variable " + std::to_string(var) + ", not in the result");
+	return it - vars.begin();
+}
+
+/*
+ * Sorts rel on group_coords and folds every run of equal groups into
+ * one tuple: the group, then ops[i] of the values at value_coords[i]
+ * (a count adds 1 per tuple if its coordinate is negative). Without
+ * group coordinates, an empty relation still has its single group if
+ * empty_group is set.
+ */
+static Relation<int> fold_groups(Relation<int>& rel, const std::vector<int>& group_coords,
+				 const std::vector<AggregateOp>& ops, const std::vector<int>& value_coords,
+				 bool empty_group)
+{
+	PhaseScope phase(Phase::Aggregate);
+	sort(rel, group_coords);
+
+	Relation<int> result(group_coords.size() + ops.size());
+	std::vector<int> identity(group_coords.size());
+	for (std::size_t i = 0; i < identity.size(); i++)
+		identity[i] = i;
+	std::vector<std::int64_t> values(ops.size());
+	Relation<int>::tuple_t group, out;
+	bool open = false;
+
+	auto flush = [&]() {
+		out = group;
+		for (std::int64_t value : values) {
+			if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max())
+				throw std::overflow_error("aggregate out of the range of int");
+			out.push_back((int) value);
+		}
+		result.push_tuple(out);
+	};
+	for (auto& tpl : rel) {
+		bool same = open;
+		for (std::size_t i = 0; i < group_coords.size() && same; i++)
+			same = tpl[group_coords[i]] == group[i];
+		if (!same) {
+			if (open)
+				flush();
+			open = true;
+			group.clear();
+			for (int coord : group_coords)
+				group.push_back(tpl[coord]);
+			for (std::size_t i = 0; i < ops.size(); i++)
+				values[i] = (ops[i] == AggregateOp::Min) ? std::numeric_limits<std::int64_t>::max() :
+					    (ops[i] == AggregateOp::Max) ? std::numeric_limits<std::int64_t>::min() : 0;
+		}
+		for (std::size_t i = 0; i < ops.size(); i++) {
+			std::int64_t x = value_coords[i] < 0 ? 1 : tpl[value_coords[i]];
+			switch (ops[i]) {
+			case AggregateOp::Min:	values[i] = std::min(values[i], x); break;
+			case AggregateOp::Max:	values[i] = std::max(values[i], x); break;
+			default:		values[i] += x;
+			}
+		}
+	}
+	if (open)
+		flush();
+	else if (group_coords.empty() && empty_group) { // the identity of every aggregate
+		group.clear();
+		for (std::size_t i = 0; i < ops.size(); i++)
+			values[i] = (ops[i] == AggregateOp::Min) ? std::numeric_limits<int>::max() :
+				    (ops[i] == AggregateOp::Max) ? std::numeric_limits<int>::min() : 0;
+		flush();
+	}
+	rel.clear();
+	result.set_order(identity);
+
+	return result;
+}
+
+Relation<int> aggregate_groups(Relation<int>& rel, const std::vector<int>& vars, const GroupBy& group_by)
+{
+	std::vector<int> group_coords;
+	for (int var : group_by.group_vars)
+		group_coords.push_back(coord_of(vars, var));
+	std::vector<AggregateOp> ops;
+	std::vector<int> value_coords;
+	for (auto& aggregate : group_by.aggregates) {
+		ops.push_back(aggregate.op);
+		value_coords.push_back(aggregate.op == AggregateOp::Count ? -1 : coord_of(vars, aggregate.var));
+	}
+
+	return fold_groups(rel, group_coords, ops, value_coords, true);
+}
+
+Relation<int> combine_groups(Relation<int>& partials, const GroupBy& group_by)
+{
+	std::size_t ngroup = group_by.group_vars.size();
+	std::vector<int> group_coords;
+	for (std::size_t i = 0; i < ngroup; i++)
+		group_coords.push_back(i);
+	std::vector<AggregateOp> ops;
+	std::vector<int> value_coords;
+	for (std::size_t i = 0; i < group_by.aggregates.size(); i++) {
+		// partial counts add up like sums
+		AggregateOp op = group_by.aggregates[i].op;
+		ops.push_back(op == AggregateOp::Count ? AggregateOp::Sum : op);
+		value_coords.push_back(ngroup + i);
+	}
+
+	// the single group of every part was sent to one process: the others must not add theirs
+	return fold_groups(partials, group_coords, ops, value_coords, false);
+}
@@ -0,0 +1,121 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <string>
+#include "catalog.h"
+#include "ioutil.h"
+#include "profile.h"
+#include "settings.h"
+#include "util.h"
+
+/*
+ * reads a relation file whole, with the arity of its first line, or
+ * from its index with settings::csr_index if it is binary, and drops
+ * its duplicate tuples with settings::distinct_inputs
+ */
+static Relation<int> read_file(const std::string& filename)
+{
+	PhaseScope phase(Phase::Read);
+	const CsrIndex* index = settings::csr_index ? relation_catalog().index(filename) : nullptr;
+	if (index) {
+		Relation<int> rel = index->relation(false);
+		if (settings::distinct_inputs)
+			distinct(rel);
+		return rel;
+	}
+
+	std::string name(filename);
+	Relation<int> rel(read_arity(name));
+	read_relation(name, rel);
+	if (settings::distinct_inputs)
+		distinct(rel);
+	return rel;
+}
+
+Relation<int>& RelationCatalog::relation(const std::string& filename)
+{
+	auto it = relations.find(filename);
+	if (it == relations.end())
+		it = relations.emplace(filename, read_file(filename)).first;
+
+	return it->second;
+}
+
+std::vector<Relation<int>>& RelationCatalog::partitioned(const std::string& filename,
+							 const std::vector<int>& key,
+							 const divider_t& divide)
+{
+	auto id = std::make_tuple(filename, key);
+	auto it = partitions.find(id);
+	if (it == partitions.end())
+		it = partitions.emplace(id, divide(relation(filename))).first;
+
+	return it->second;
+}
+
+const CsrIndex* RelationCatalog::index(const std::string& filename)
+{
+	auto it = indexes.find(filename);
+	if (it == indexes.end()) {
+		std::unique_ptr<CsrIndex> index;
+		std::string name(filename);
+		if (read_arity(name) == 2) {
+			if (!csr_index_current(filename))
+				build_csr_index(filename);
+			index.reset(new CsrIndex(filename));
+		}
+		it = indexes.emplace(filename, std::move(index)).first;
+	}
+
+	return it->second.get();
+}
+
+void RelationCatalog::clear()
+{
+	relations.clear();
+	partitions.clear();
+	indexes.clear();
+}
+
+RelationCatalog& relation_catalog()
+{
+	// one per thread, like the relations read by the shared-memory backend
+	static thread_local RelationCatalog catalog;
+	return catalog;
+}
+
+/* number of nested scopes of the calling thread */
+static thread_local int catalog_scopes = 0;
+
+CatalogScope::CatalogScope()
+{
+	catalog_scopes++;
+}
+
+CatalogScope::~CatalogScope()
+{
+	if (--catalog_scopes == 0)
+		relation_catalog().clear();
+}
+
+void load_relation(const std::string& filename, Relation<int>& rel)
+{
+	if (settings::cache_relations)
+		rel = relation_catalog().relation(filename);
+	else
+		rel = read_file(filename);
+}
+
+std::vector<Relation<int>> load_partitioned(const std::string& filename,
+					    const std::vector<int>& key,
+					    const RelationCatalog::divider_t& divide)
+{
+	if (settings::cache_relations)
+		return relation_catalog().partitioned(filename, key, divide);
+
+	Relation<int> rel = read_file(filename);
+	return divide(rel);
+}
@@ -0,0 +1,400 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <boost/mpi.hpp>
+#include <boost/mpi/collectives.hpp>
+#include "communicator.h"
+#include "compress.h"
+#include "settings.h"
+
+namespace mpi = boost::mpi;
+
+/*
+ * One process per MPI rank. Relations are serialized by Boost, and
+ * encoded first when settings::compress_shuffles is on.
+ */
+class MpiCommunicator : public Communicator {
+private:
+	mpi::communicator world;
+public:
+	int rank() const override { return world.rank(); }
+	int size() const override { return world.size(); }
+	void barrier() override { world.barrier(); }
+
+	std::size_t scatter(std::vector<Relation<int>>& parts,
+			    Relation<int>& part, int root) override
+	{
+		std::size_t sent = 0;
+		if (!settings::compress_shuffles) {
+			if (rank() == root)
+				for (auto& rel : parts)
+					sent += wire_size(rel);
+			mpi::scatter(world, parts, part, root);
+			return sent;
+		}
+
+		std::vector<CompressedRelation> encoded;
+		if (rank() == root)
+			for (auto& rel : parts) {
+				encoded.emplace_back(rel);
+				sent += encoded.back().encoded_bytes();
+			}
+		CompressedRelation received;
+		mpi::scatter(world, encoded, received, root);
+		part.clear();
+		received.decode(part);
+		return sent;
+	}
+
+	std::size_t gather(Relation<int>& part,
+			   std::vector<Relation<int>>& parts, int root) override
+	{
+		if (!settings::compress_shuffles) {
+			mpi::gather(world, part, parts, root);
+			return wire_size(part);
+		}
+
+		CompressedRelation encoded(part);
+		std::vector<CompressedRelation> received;
+		mpi::gather(world, encoded, received, root);
+		if (rank() == root) {
+			parts.assign(received.size(), Relation<int>());
+			for (std::size_t i = 0; i < received.size(); i++)
+				received[i].decode(parts[i]);
+		}
+		return encoded.encoded_bytes();
+	}
+
+	std::size_t broadcast(Relation<int>& rel, int root) override
+	{
+		// the root sends its relation to each one of the other processes
+		std::size_t copies = (rank() == root) ? size() - 1 : 0;
+		if (!settings::compress_shuffles) {
+			mpi::broadcast(world, rel, root);
+			return copies * wire_size(rel);
+		}
+
+		CompressedRelation encoded;
+		if (rank() == root)
+			encoded = CompressedRelation(rel);
+		mpi::broadcast(world, encoded, root);
+		if (rank() != root) {
+			rel.clear();
+			encoded.decode(rel);
+		}
+		return copies * encoded.encoded_bytes();
+	}
+
+	void broadcast(int& value, int root) override
+	{
+		mpi::broadcast(world, value, root);
+	}
+
+	void broadcast(std::vector<int>& values, int root) override
+	{
+		mpi::broadcast(world, values, root);
+	}
+
+	void reduce(std::vector<std::size_t>& values, ReduceOp op, int root) override
+	{
+		std::vector<std::size_t> result(values.size());
+		if (op == ReduceOp::Sum)
+			mpi::reduce(world, values.data(), values.size(), result.data(),
+				    std::plus<std::size_t>(), root);
+		else
+			mpi::reduce(world, values.data(), values.size(), result.data(),
+				    mpi::maximum<std::size_t>(), root);
+		if (rank() == root)
+			values = result;
+	}
+
+	std::size_t send(Relation<int>& rel, int dest, int tag) override
+	{
+		if (!settings::compress_shuffles) {
+			world.send(dest, tag, rel);
+			return wire_size(rel);
+		}
+
+		CompressedRelation encoded(rel);
+		world.send(dest, tag, encoded);
+		return encoded.encoded_bytes();
+	}
+
+	void recv(Relation<int>& rel, int src, int tag) override
+	{
+		int source = (src == any_source) ? mpi::any_source : src;
+		if (!settings::compress_shuffles) {
+			world.recv(source, tag, rel);
+			return;
+		}
+
+		CompressedRelation encoded;
+		world.recv(source, tag, encoded);
+		rel.clear();
+		encoded.decode(rel);
+	}
+
+	void send(int value, int dest, int tag) override
+	{
+		world.send(dest, tag, value);
+	}
+
+	int recv(int& value, int src, int tag) override
+	{
+		int source = (src == any_source) ? mpi::any_source : src;
+		return world.recv(source, tag, value).source();
+	}
+
+	bool probe(int tag) override
+	{
+		return (bool) world.iprobe(mpi::any_source, tag);
+	}
+};
+
+/*
+ * Queue of the point-to-point messages sent to one thread
+ */
+struct Mailbox {
+	struct Message {
+		int src;
+		int tag;
+		int value;
+		Relation<int> rel;
+	};
+
+	std::deque<Message> messages;
+	std::mutex mutex;
+	std::condition_variable cv;
+
+	void post(Message&& msg)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		messages.push_back(std::move(msg));
+		cv.notify_all();
+	}
+
+	/* removes the first message from src (or anyone) with this tag, waiting for it */
+	Message take(int src, int tag)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			for (auto it = messages.begin(); it != messages.end(); it++)
+				if (it->tag == tag && (src == Communicator::any_source || it->src == src)) {
+					Message msg = std::move(*it);
+					messages.erase(it);
+					return msg;
+				}
+			cv.wait(lock);
+		}
+	}
+
+	bool contains(int tag)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& msg : messages)
+			if (msg.tag == tag)
+				return true;
+		return false;
+	}
+};
+
+/*
+ * State shared by the threads of run_on_threads: a reusable barrier,
+ * and one slot per rank where a thread publishes the address of the
+ * data it contributes to the current collective operation.
+ */
+struct ThreadGroup {
+	int size;
+	std::vector<void*> slots;
+	std::unique_ptr<Mailbox[]> mailboxes;
+	std::mutex mutex;
+	std::condition_variable cv;
+	int arrived;
+	unsigned long generation;
+
+	explicit ThreadGroup(int n)
+		: size{n}, slots(n, nullptr), mailboxes{new Mailbox[n]}, arrived{0}, generation{0} {}
+
+	void barrier()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		unsigned long gen = generation;
+		if (++arrived == size) {
+			arrived = 0;
+			generation++;
+			cv.notify_all();
+		} else {
+			cv.wait(lock, [this, gen] { return generation != gen; });
+		}
+	}
+};
+
+/*
+ * One thread per rank. Every collective operation is: publish an
+ * address, barrier, read the addresses published by the others,
+ * barrier (so that no published data goes away while being read).
+ * Relations are moved from the sender to the receiver, except for
+ * broadcasts, where each receiver needs its own copy. Point-to-point
+ * messages go through the mailbox of the receiver.
+ */
+class ThreadCommunicator : public Communicator {
+private:
+	ThreadGroup& group;
+	int my_rank;
+
+	/* every process gets a copy of value of the root */
+	template<typename T>
+	void share(T& value, int root)
+	{
+		if (my_rank == root)
+			group.slots[root] = &value;
+		group.barrier();
+		if (my_rank != root)
+			value = *static_cast<T*>(group.slots[root]);
+		group.barrier();
+	}
+public:
+	ThreadCommunicator(ThreadGroup& g, int r) : group(g), my_rank{r} {}
+
+	int rank() const override { return my_rank; }
+	int size() const override { return group.size; }
+	void barrier() override { group.barrier(); }
+
+	std::size_t scatter(std::vector<Relation<int>>& parts,
+			    Relation<int>& part, int root) override
+	{
+		if (my_rank == root)
+			group.slots[root] = &parts;
+		group.barrier();
+		auto& all_parts = *static_cast<std::vector<Relation<int>>*>(group.slots[root]);
+		part = std::move(all_parts[my_rank]);
+		group.barrier();
+		return 0;
+	}
+
+	std::size_t gather(Relation<int>& part,
+			   std::vector<Relation<int>>& parts, int root) override
+	{
+		group.slots[my_rank] = &part;
+		group.barrier();
+		if (my_rank == root) {
+			parts.clear();
+			for (void* slot : group.slots)
+				parts.push_back(std::move(*static_cast<Relation<int>*>(slot)));
+		}
+		group.barrier();
+		return 0;
+	}
+
+	std::size_t broadcast(Relation<int>& rel, int root) override
+	{
+		share(rel, root);
+		return 0;
+	}
+
+	void broadcast(int& value, int root) override
+	{
+		share(value, root);
+	}
+
+	void broadcast(std::vector<int>& values, int root) override
+	{
+		share(values, root);
+	}
+
+	void reduce(std::vector<std::size_t>& values, ReduceOp op, int root) override
+	{
+		group.slots[my_rank] = &values;
+		group.barrier();
+		std::vector<std::size_t> result(values);
+		if (my_rank == root)
+			for (void* slot : group.slots) {
+				auto& other = *static_cast<std::vector<std::size_t>*>(slot);
+				if (&other == &values)
+					continue;
+				for (std::size_t i = 0; i < result.size(); i++)
+					result[i] = (op == ReduceOp::Sum) ? result[i] + other[i]
+									  : std::max(result[i], other[i]);
+			}
+		group.barrier();
+		if (my_rank == root)
+			values = result;
+	}
+
+	std::size_t send(Relation<int>& rel, int dest, int tag) override
+	{
+		group.mailboxes[dest].post(Mailbox::Message{my_rank, tag, 0, std::move(rel)});
+		return 0;
+	}
+
+	void recv(Relation<int>& rel, int src, int tag) override
+	{
+		rel = std::move(group.mailboxes[my_rank].take(src, tag).rel);
+	}
+
+	void send(int value, int dest, int tag) override
+	{
+		group.mailboxes[dest].post(Mailbox::Message{my_rank, tag, value, Relation<int>()});
+	}
+
+	int recv(int& value, int src, int tag) override
+	{
+		auto msg = group.mailboxes[my_rank].take(src, tag);
+		value = msg.value;
+		return msg.src;
+	}
+
+	bool probe(int tag) override
+	{
+		return group.mailboxes[my_rank].contains(tag);
+	}
+};
+
+/* communicator installed on the calling thread by run_on_threads */
+static thread_local Communicator* thread_communicator = nullptr;
+
+/*
+ * Returns the communicator of the calling thread: the one installed by
+ * run_on_threads, or else the MPI communicator of all ranks.
+ */
+Communicator& current_communicator()
+{
+	if (thread_communicator)
+		return *thread_communicator;
+
+	static MpiCommunicator world;
+	return world;
+}
+
+/*
+ * Runs body on nthreads threads of this process, each one seeing
+ * through current_communicator() a communicator of size nthreads
+ * whose ranks are the threads. Returns when every thread is done.
+ *
+ * @param nthreads number of threads (ranks)
+ * @param body function run by every thread
+ */
+void run_on_threads(int nthreads, const std::function<void()>& body)
+{
+	ThreadGroup group(nthreads);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < nthreads; i++)
+		threads.emplace_back([&group, &body, i]() {
+			ThreadCommunicator comm(group, i);
+			thread_communicator = &comm;
+			body();
+			thread_communicator = nullptr;
+		});
+
+	for (auto& thread : threads)
+		thread.join();
+}
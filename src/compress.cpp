@@ -0,0 +1,102 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include "compress.h"
+
+/*
+ * Appends x to buffer as a variable-byte integer: seven bits per
+ * byte, least significant group first, high bit set on every byte
+ * but the last one.
+ */
+static void put_varint(std::vector<unsigned char>& buffer, std::uint64_t x)
+{
+	while (x >= 0x80) {
+		buffer.push_back(static_cast<unsigned char>(x | 0x80));
+		x >>= 7;
+	}
+	buffer.push_back(static_cast<unsigned char>(x));
+}
+
+/*
+ * Reads a variable-byte integer starting at position pos of buffer
+ * and advances pos past it.
+ */
+static std::uint64_t get_varint(const std::vector<unsigned char>& buffer, std::size_t& pos)
+{
+	std::uint64_t x = 0;
+	for (int shift = 0; ; shift += 7) {
+		if (pos >= buffer.size())
+			throw std::runtime_error("truncated compressed relation");
+		unsigned char byte = buffer[pos++];
+		x |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return x;
+	}
+}
+
+/* maps signed differences to unsigned so that small magnitudes stay small */
+static std::uint64_t zigzag(std::int64_t x)
+{
+	return (static_cast<std::uint64_t>(x) << 1) ^ static_cast<std::uint64_t>(x >> 63);
+}
+
+static std::int64_t unzigzag(std::uint64_t x)
+{
+	return static_cast<std::int64_t>(x >> 1) ^ -static_cast<std::int64_t>(x & 1);
+}
+
+CompressedRelation::CompressedRelation(Relation<int>& rel)
+	: arity{rel.get_arity()}, count{rel.size()}
+{
+	using tuple_t = Relation<int>::tuple_t;
+
+	// sort pointers rather than the tuples so that rel stays as it is
+	std::vector<const tuple_t*> order;
+	order.reserve(rel.size());
+	for (auto& tpl : rel)
+		order.push_back(&tpl);
+	std::sort(order.begin(), order.end(),
+		  [](const tuple_t* a, const tuple_t* b) { return *a < *b; });
+
+	data.reserve(count * arity);
+	tuple_t prev(arity, 0);
+	for (const tuple_t* tpl : order) {
+		put_varint(data, static_cast<std::int64_t>((*tpl)[0]) - prev[0]);
+		for (std::size_t i = 1; i < arity; i++)
+			put_varint(data, zigzag(static_cast<std::int64_t>((*tpl)[i]) - prev[i]));
+		prev = *tpl;
+	}
+}
+
+void CompressedRelation::decode(Relation<int>& rel) const
+{
+	bool was_empty = (rel.size() == 0);
+	rel.set_arity(arity);
+
+	// differences are added modulo 2^32 to get back the original ints
+	std::size_t pos = 0;
+	std::vector<std::uint32_t> acc(arity, 0);
+	Relation<int>::tuple_t tpl(arity);
+	for (std::size_t n = 0; n < count; n++) {
+		acc[0] += static_cast<std::uint32_t>(get_varint(data, pos));
+		for (std::size_t i = 1; i < arity; i++)
+			acc[i] += static_cast<std::uint32_t>(unzigzag(get_varint(data, pos)));
+		for (std::size_t i = 0; i < arity; i++)
+			tpl[i] = static_cast<int>(acc[i]);
+		rel.push_tuple(tpl);
+	}
+
+	// the tuples were encoded in lexicographic order
+	if (was_empty) {
+		std::vector<int> order(arity);
+		for (std::size_t i = 0; i < arity; i++)
+			order[i] = i;
+		rel.set_order(order);
+	}
+}
@@ -0,0 +1,269 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "csr.h"
+#include "ioutil.h"
+#include "profile.h"
+#include "util.h"
+
+/* first bytes of an index file, with the version of the format */
+static const char CSR_MAGIC[8] = "njcsr01";
+
+/* steps of an index join between two polls of its stopping condition */
+static const std::size_t POLL_INTERVAL = 1024;
+
+/*
+ * Layout of an index file: this header, then the forward and the
+ * backward directions, each one made of its offsets (num_keys + 1
+ * words), its keys and its neighbors (num_tuples ints), padded to a
+ * multiple of 8 bytes
+ */
+struct CsrHeader {
+	char magic[8];
+	std::uint64_t num_tuples;
+	std::uint64_t num_keys[2];
+};
+
+/* bytes of a direction of num_keys keys in the index file */
+static std::size_t direction_bytes(std::size_t num_keys, std::size_t num_tuples)
+{
+	std::size_t bytes = (num_keys + 1) * sizeof(std::uint64_t) + (num_keys + num_tuples) * sizeof(int);
+	return (bytes + 7) / 8 * 8;
+}
+
+std::string csr_file_name(const std::string& filename)
+{
+	return filename + ".csr";
+}
+
+bool csr_index_current(const std::string& filename)
+{
+	struct stat rel_stat, index_stat;
+	if (stat(filename.c_str(), &rel_stat) != 0 || stat(csr_file_name(filename).c_str(), &index_stat) != 0)
+		return false;
+	return index_stat.st_mtim.tv_sec > rel_stat.st_mtim.tv_sec ||
+		(index_stat.st_mtim.tv_sec == rel_stat.st_mtim.tv_sec &&
+		 index_stat.st_mtim.tv_nsec >= rel_stat.st_mtim.tv_nsec);
+}
+
+/*
+ * Writes a direction of the index: the tuples, sorted, whose first
+ * column is the key
+ */
+static void write_direction(std::ofstream& out, const std::vector<std::pair<int, int>>& tuples)
+{
+	std::vector<std::uint64_t> offsets;
+	std::vector<int> keys, neighbors;
+	neighbors.reserve(tuples.size());
+	for (std::size_t i = 0; i < tuples.size(); i++) {
+		if (i == 0 || tuples[i].first != tuples[i - 1].first) {
+			keys.push_back(tuples[i].first);
+			offsets.push_back(i);
+		}
+		neighbors.push_back(tuples[i].second);
+	}
+	offsets.push_back(tuples.size());
+
+	out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(std::uint64_t));
+	out.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(int));
+	out.write(reinterpret_cast<const char*>(neighbors.data()), neighbors.size() * sizeof(int));
+	std::size_t written = offsets.size() * sizeof(std::uint64_t) + (keys.size() + neighbors.size()) * sizeof(int);
+	std::vector<char> padding(direction_bytes(keys.size(), neighbors.size()) - written, 0);
+	out.write(padding.data(), padding.size());
+}
+
+/* number of distinct first columns of sorted tuples */
+static std::size_t count_keys(const std::vector<std::pair<int, int>>& tuples)
+{
+	std::size_t num_keys = 0;
+	for (std::size_t i = 0; i < tuples.size(); i++)
+		if (i == 0 || tuples[i].first != tuples[i - 1].first)
+			num_keys++;
+	return num_keys;
+}
+
+void build_csr_index(const std::string& filename)
+{
+	PhaseScope phase(Phase::Read);
+	std::string name(filename);
+	if (read_arity(name) != 2)
+		throw std::invalid_argument("cannot index " + filename + ", which is not a binary relation");
+	Relation<int> rel(2);
+	read_relation(name, rel);
+
+	std::vector<std::pair<int, int>> forward, backward;
+	forward.reserve(rel.size());
+	backward.reserve(rel.size());
+	for (auto& tpl : rel) {
+		forward.emplace_back(tpl[0], tpl[1]);
+		backward.emplace_back(tpl[1], tpl[0]);
+	}
+	rel.clear();
+	std::sort(forward.begin(), forward.end());
+	std::sort(backward.begin(), backward.end());
+
+	CsrHeader header;
+	std::memcpy(header.magic, CSR_MAGIC, sizeof(header.magic));
+	header.num_tuples = forward.size();
+	header.num_keys[0] = count_keys(forward);
+	header.num_keys[1] = count_keys(backward);
+
+	// no other process or thread writes the same temporary file
+	std::string index_name = csr_file_name(filename);
+	std::string temp_name = index_name + "-" + std::to_string(getpid()) + "-" +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		std::ofstream out(temp_name, std::ios::binary | std::ios::trunc);
+		if (!out)
+			throw std::runtime_error("cannot create index file " + temp_name);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		write_direction(out, forward);
+		write_direction(out, backward);
+		if (!out)
+			throw std::runtime_error("cannot write index file " + temp_name);
+	}
+	if (std::rename(temp_name.c_str(), index_name.c_str()) != 0) {
+		std::remove(temp_name.c_str());
+		throw std::runtime_error("cannot write index file " + index_name);
+	}
+}
+
+CsrIndex::CsrIndex(const std::string& filename) : data{nullptr}, length{0}, num_tuples{0}
+{
+	std::string index_name = csr_file_name(filename);
+	int fd = open(index_name.c_str(), O_RDONLY);
+	struct stat index_stat;
+	if (fd < 0 || fstat(fd, &index_stat) != 0) {
+		if (fd >= 0)
+			close(fd);
+		throw std::runtime_error("cannot open index file " + index_name);
+	}
+	length = index_stat.st_size;
+	if (length >= sizeof(CsrHeader))
+		data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == nullptr || data == MAP_FAILED) {
+		data = nullptr;
+		throw std::runtime_error("cannot map index file " + index_name);
+	}
+
+	const CsrHeader* header = static_cast<const CsrHeader*>(data);
+	num_tuples = header->num_tuples;
+	std::size_t expected = sizeof(CsrHeader);
+	bool valid = std::memcmp(header->magic, CSR_MAGIC, sizeof(header->magic)) == 0;
+	for (int d = 0; d < 2 && valid; d++) {
+		Direction& direction = directions[d];
+		direction.num_keys = header->num_keys[d];
+		const char* section = static_cast<const char*>(data) + expected;
+		expected += direction_bytes(direction.num_keys, num_tuples);
+		valid = expected <= length;
+		direction.offsets = reinterpret_cast<const std::uint64_t*>(section);
+		direction.keys = reinterpret_cast<const int*>(direction.offsets + direction.num_keys + 1);
+		direction.neighbors = direction.keys + direction.num_keys;
+	}
+	if (!valid || expected != length) {
+		munmap(data, length);
+		data = nullptr;
+		throw std::runtime_error("malformed index file " + index_name);
+	}
+}
+
+CsrIndex::~CsrIndex()
+{
+	if (data != nullptr)
+		munmap(data, length);
+}
+
+std::pair<const int*, const int*> CsrIndex::neighbors(int key, bool backward) const
+{
+	const Direction& direction = directions[backward ? 1 : 0];
+	const int* keys_end = direction.keys + direction.num_keys;
+	const int* it = std::lower_bound(direction.keys, keys_end, key);
+	if (it == keys_end || *it != key)
+		return std::make_pair(direction.neighbors, direction.neighbors);
+	std::size_t i = it - direction.keys;
+	return std::make_pair(direction.neighbors + direction.offsets[i], direction.neighbors + direction.offsets[i + 1]);
+}
+
+Relation<int> CsrIndex::relation(bool backward) const
+{
+	const Direction& direction = directions[backward ? 1 : 0];
+	Relation<int> rel(2);
+	for (std::size_t i = 0; i < direction.num_keys; i++)
+		for (std::uint64_t j = direction.offsets[i]; j < direction.offsets[i + 1]; j++) {
+			if (backward)
+				rel.push_tuple({direction.neighbors[j], direction.keys[i]});
+			else
+				rel.push_tuple({direction.keys[i], direction.neighbors[j]});
+		}
+	rel.set_order(backward ? std::vector<int>{1, 0} : std::vector<int>{0, 1});
+
+	return rel;
+}
+
+Relation<int> index_join(Relation<int>& rel1,
+			 const CsrIndex& index,
+			 const std::vector<int>& vars1,
+			 const std::vector<int>& vars2,
+			 std::size_t limit,
+			 const std::function<bool()>& stopped,
+			 const std::vector<Predicate>& predicates)
+{
+	PhaseScope phase(Phase::Join);
+	auto unique_vars = get_unique_vars(vars1, vars2);
+	Selection selection(join_predicates(predicates, vars1, vars2, unique_vars), unique_vars);
+	// the selection the second relation would have had when it was read
+	Selection tuple_selection(bound_predicates(predicates, vars2), vars2);
+	auto coord = [&vars1](int var) {
+		auto it = std::find(vars1.begin(), vars1.end(), var);
+		return it == vars1.end() ? -1 : (int) (it - vars1.begin());
+	};
+	int coord_u = coord(vars2[0]), coord_v = coord(vars2[1]);
+	if (coord_u < 0 && coord_v < 0)
+		throw std::invalid_argument("index join without common variable");
+	// look up the first column if it is bound, else the second one
+	bool backward = coord_u < 0;
+
+	Relation<int> join_rel(unique_vars.size());
+	Relation<int>::tuple_t tpl2(2);
+	bool done = false;
+	std::size_t steps = 0;
+	for (auto it = rel1.begin(); !done && it != rel1.end(); it++) {
+		if (stopped && ++steps % POLL_INTERVAL == 0 && stopped())
+			break;
+		auto& tpl1 = *it;
+		if (!consistent(tpl1, vars1))
+			continue;
+		auto range = index.neighbors(tpl1[backward ? coord_v : coord_u], backward);
+		if (coord_u >= 0 && coord_v >= 0) // both ends bound: the tuples equal to both
+			range = std::equal_range(range.first, range.second, tpl1[coord_v]);
+		for (const int* neighbor = range.first; !done && neighbor != range.second; neighbor++) {
+			tpl2[0] = backward ? *neighbor : tpl1[coord_u];
+			tpl2[1] = backward ? tpl1[coord_v] : *neighbor;
+			if (!consistent(tpl2, vars2) || !tuple_selection(tpl2))
+				continue;
+			auto tpl = merge_reduce_tpls(tpl1, tpl2, vars1, vars2, unique_vars);
+			if (selection(tpl)) {
+				join_rel.push_tuple(std::move(tpl));
+				done = (join_rel.size() == limit);
+			}
+		}
+	}
+	join_rel.set_order(join_output_order(rel1.get_order(), vars1, unique_vars));
+	record_join(rel1.size(), index.size(), join_rel.size());
+
+	return join_rel;
+}
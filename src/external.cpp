@@ -0,0 +1,432 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "external.h"
+#include "settings.h"
+#include "util.h"
+
+using tuple_t = Relation<int>::tuple_t;
+
+/* bounds of the values read or written per system call, the block of a run */
+static const std::size_t MIN_BLOCK_INTS = 1 << 10;
+static const std::size_t MAX_BLOCK_INTS = 1 << 18;
+
+/* steps of the merge between two polls of its stopping condition */
+static const std::size_t POLL_INTERVAL = 1024;
+
+/* runs merged at once: more runs are merged in several passes */
+static const std::size_t MAX_FAN_IN = 16;
+
+std::size_t memory_footprint(Relation<int>& rel)
+{
+	// per tuple: the vector object, its values and the allocator overhead
+	return rel.size() * (sizeof(tuple_t) + rel.get_arity() * sizeof(int) + 16);
+}
+
+/*
+ * Returns a file name in the scratch directory that no other process
+ * or thread uses
+ */
+static std::string scratch_file_name()
+{
+	static std::atomic<unsigned long> counter{0};
+	return settings::scratch_dir + "/join-" + std::to_string(getpid()) + "-" +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) +
+		"-" + std::to_string(counter++) + ".run";
+}
+
+/*
+ * Scratch file holding a run, removed with the object, so that the
+ * runs of a join that throws are removed too
+ */
+class RunFile {
+private:
+	std::string name;
+public:
+	RunFile() : name(scratch_file_name()) {}
+	RunFile(RunFile&& other) noexcept : name(std::move(other.name)) { other.name.clear(); }
+	RunFile(const RunFile&) = delete;
+	RunFile& operator=(const RunFile&) = delete;
+	~RunFile()
+	{
+		if (!name.empty())
+			std::remove(name.c_str());
+	}
+
+	const std::string& file_name() const { return name; }
+};
+
+/*
+ * Writes tuples of a fixed arity to a file, one block at a time. The
+ * last block is written by close; a writer destroyed before, when an
+ * exception unwinds, writes what it can and reports nothing.
+ */
+class RunWriter {
+private:
+	std::ofstream out;
+	std::vector<int> block;
+	std::size_t block_ints;
+public:
+	RunWriter(const RunFile& run, std::size_t block_size)
+		: out(run.file_name(), std::ios::binary | std::ios::trunc), block_ints{block_size}
+	{
+		if (!out)
+			throw std::runtime_error("cannot create scratch file " + run.file_name());
+		block.reserve(block_ints);
+	}
+
+	void write(const tuple_t& tpl)
+	{
+		if (block.size() + tpl.size() > block_ints)
+			flush();
+		block.insert(block.end(), tpl.begin(), tpl.end());
+	}
+
+	void flush()
+	{
+		out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(int));
+		if (!out)
+			throw std::runtime_error("cannot write scratch file");
+		block.clear();
+	}
+
+	void close()
+	{
+		flush();
+		out.close();
+		if (!out)
+			throw std::runtime_error("cannot write scratch file");
+	}
+
+	~RunWriter()
+	{
+		if (out.is_open())
+			out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(int));
+	}
+};
+
+/*
+ * Reads back the tuples written by a RunWriter, one block at a time
+ */
+class RunReader {
+private:
+	std::ifstream in;
+	std::size_t arity;
+	std::size_t block_ints;
+	std::vector<int> block;
+	std::size_t pos;
+public:
+	RunReader(const RunFile& run, std::size_t n, std::size_t block_size)
+		: in(run.file_name(), std::ios::binary), arity{n},
+		  block_ints{std::max(block_size - block_size % n, n)}, pos{0}
+	{
+		if (!in)
+			throw std::runtime_error("cannot open scratch file " + run.file_name());
+	}
+
+	/* reads the next tuple into tpl, returns false at the end of the run */
+	bool next(tuple_t& tpl)
+	{
+		if (pos == block.size()) {
+			block.resize(block_ints);
+			in.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(int));
+			block.resize(in.gcount() / sizeof(int));
+			pos = 0;
+			if (block.empty()) {
+				block.shrink_to_fit();
+				return false;
+			}
+		}
+		tpl.assign(block.begin() + pos, block.begin() + pos + arity);
+		pos += arity;
+		return true;
+	}
+};
+
+/*
+ * Lexicographic order of tuples on the coordinates given by perm
+ */
+struct PermLess {
+	std::vector<int> perm;
+
+	bool operator()(const tuple_t& A, const tuple_t& B) const
+	{
+		for (int i : perm) {
+			if (A[i] < B[i])	return true;
+			else if (A[i] > B[i])	return false;
+		}
+		return false;
+	}
+};
+
+/*
+ * Empties a relation into sorted runs of at most run_tuples tuples
+ *
+ * @param rel relation to spill (emptied)
+ * @param less order of the runs
+ * @param run_tuples maximum number of tuples per run
+ * @param block_ints values written per system call
+ * @return the run files
+ */
+static std::vector<RunFile> spill_sorted_runs(Relation<int>& rel, const PermLess& less,
+					      std::size_t run_tuples, std::size_t block_ints)
+{
+	std::vector<RunFile> runs;
+	std::vector<tuple_t> chunk;
+	auto write_chunk = [&]() {
+		std::sort(chunk.begin(), chunk.end(), less);
+		runs.emplace_back();
+		RunWriter writer(runs.back(), block_ints);
+		for (auto& tpl : chunk)
+			writer.write(tpl);
+		writer.close();
+		chunk.clear();
+	};
+
+	for (auto& tpl : rel) {
+		chunk.push_back(std::move(tpl));
+		if (chunk.size() == run_tuples)
+			write_chunk();
+	}
+	if (!chunk.empty())
+		write_chunk();
+
+	Relation<int> empty(rel.get_arity());
+	rel = std::move(empty);
+
+	return runs;
+}
+
+/*
+ * Merges sorted runs into a single sorted stream of tuples, skipping
+ * the tuples inconsistent with their variables. It holds a block and
+ * a tuple per run.
+ */
+class MergedRuns {
+private:
+	using entry_t = std::pair<tuple_t, std::size_t>;
+
+	struct EntryGreater {
+		PermLess less;
+		bool operator()(const entry_t& a, const entry_t& b) const
+		{
+			return less(b.first, a.first);
+		}
+	};
+
+	std::vector<std::unique_ptr<RunReader>> readers;
+	std::priority_queue<entry_t, std::vector<entry_t>, EntryGreater> heap;
+	std::vector<int> vars;
+
+	void refill(std::size_t run)
+	{
+		tuple_t tpl;
+		while (readers[run]->next(tpl))
+			if (consistent(tpl, vars)) {
+				heap.push(entry_t(std::move(tpl), run));
+				return;
+			}
+	}
+public:
+	MergedRuns(std::vector<RunFile>::const_iterator first, std::vector<RunFile>::const_iterator last,
+		   std::size_t arity, const PermLess& less, const std::vector<int>& v, std::size_t block_ints)
+		: heap(EntryGreater{less}), vars(v)
+	{
+		for (auto it = first; it != last; it++) {
+			readers.emplace_back(new RunReader(*it, arity, block_ints));
+			refill(readers.size() - 1);
+		}
+	}
+
+	bool empty() const { return heap.empty(); }
+	const tuple_t& top() const { return heap.top().first; }
+
+	void pop()
+	{
+		std::size_t run = heap.top().second;
+		heap.pop();
+		refill(run);
+	}
+};
+
+/*
+ * Merges runs MAX_FAN_IN at a time into longer runs, in as many passes
+ * as needed for at most MAX_FAN_IN of them to remain. The merged runs
+ * are removed after each pass.
+ */
+static void merge_passes(std::vector<RunFile>& runs, std::size_t arity, const PermLess& less,
+			 const std::vector<int>& vars, std::size_t block_ints)
+{
+	while (runs.size() > MAX_FAN_IN) {
+		std::vector<RunFile> merged;
+		for (std::size_t first = 0; first < runs.size(); first += MAX_FAN_IN) {
+			std::size_t last = std::min(first + MAX_FAN_IN, runs.size());
+			merged.emplace_back();
+			RunWriter writer(merged.back(), block_ints);
+			MergedRuns stream(runs.begin() + first, runs.begin() + last, arity, less, vars, block_ints);
+			for (; !stream.empty(); stream.pop())
+				writer.write(stream.top());
+			writer.close();
+		}
+		runs = std::move(merged);
+	}
+}
+
+/*
+ * Tuples of the second relation sharing one join key. The first
+ * max_tuples of them are held in memory; a larger group is written to
+ * a run instead, read again for each tuple of the first relation with
+ * that key.
+ */
+class KeyGroup {
+private:
+	std::size_t arity, max_tuples, block_ints;
+	std::vector<tuple_t> tuples;
+	tuple_t first;
+	std::unique_ptr<RunFile> run;
+	std::unique_ptr<RunWriter> writer;
+public:
+	KeyGroup(std::size_t n, std::size_t max_size, std::size_t block_size)
+		: arity{n}, max_tuples{max_size}, block_ints{block_size} {}
+
+	void clear()
+	{
+		tuples.clear();
+		writer.reset();
+		run.reset();
+	}
+
+	void add(const tuple_t& tpl)
+	{
+		if (tuples.empty() && !run)
+			first = tpl;
+		if (!run && tuples.size() < max_tuples) {
+			tuples.push_back(tpl);
+			return;
+		}
+		if (!run) {
+			run.reset(new RunFile());
+			writer.reset(new RunWriter(*run, block_ints));
+			for (auto& buffered : tuples)
+				writer->write(buffered);
+			tuples.clear();
+		}
+		writer->write(tpl);
+	}
+
+	/* to be called once the group is complete, before for_each */
+	void close()
+	{
+		if (writer) {
+			writer->close();
+			writer.reset();
+		}
+	}
+
+	/* a tuple of the group, for its join key */
+	const tuple_t& front() const { return first; }
+
+	/* calls f on each tuple of the group while it returns true */
+	void for_each(const std::function<bool(const tuple_t&)>& f) const
+	{
+		for (auto& tpl : tuples)
+			if (!f(tpl))
+				return;
+		if (run) {
+			RunReader reader(*run, arity, block_ints);
+			tuple_t tpl;
+			while (reader.next(tpl))
+				if (!f(tpl))
+					return;
+		}
+	}
+};
+
+Relation<int> external_join(Relation<int>& rel1,
+			    Relation<int>& rel2,
+			    const std::vector<int>& vars1,
+			    const std::vector<int>& vars2,
+			    std::size_t budget,
+			    std::size_t limit,
+			    const std::function<bool()>& stopped,
+			    const std::vector<Predicate>& predicates)
+{
+	auto common_vars = common_elems(vars1, vars2);
+	auto unique_vars = get_unique_vars(vars1, vars2);
+	Selection selection(join_predicates(predicates, vars1, vars2, unique_vars), unique_vars);
+	auto matching1 = index_common_variables(vars1, common_vars);
+	auto matching2 = index_common_variables(vars2, common_vars);
+	PermLess less1{get_perm(vars1, common_vars)};
+	PermLess less2{get_perm(vars2, common_vars)};
+	std::size_t arity1 = rel1.get_arity(), arity2 = rel2.get_arity();
+
+	// the merge reads both relations at once, each one through at most
+	// MAX_FAN_IN blocks, which take half of the budget; a run, while sorted
+	// in memory, takes another half, and a group of equal keys a quarter
+	std::size_t block_ints = std::min(MAX_BLOCK_INTS,
+		std::max(MIN_BLOCK_INTS, budget / 4 / MAX_FAN_IN / sizeof(int)));
+	std::size_t tuple_bytes = sizeof(tuple_t) + std::max(arity1, arity2) * sizeof(int) + 16;
+	std::size_t run_tuples = std::max(block_ints / std::max(arity1, arity2), budget / 2 / tuple_bytes);
+	std::size_t group_tuples = std::max<std::size_t>(1, budget / 4 / tuple_bytes);
+
+	auto runs1 = spill_sorted_runs(rel1, less1, run_tuples, block_ints);
+	auto runs2 = spill_sorted_runs(rel2, less2, run_tuples, block_ints);
+	merge_passes(runs1, arity1, less1, vars1, block_ints);
+	merge_passes(runs2, arity2, less2, vars2, block_ints);
+
+	Relation<int> join_rel(unique_vars.size());
+	MergedRuns stream1(runs1.begin(), runs1.end(), arity1, less1, vars1, block_ints);
+	MergedRuns stream2(runs2.begin(), runs2.end(), arity2, less2, vars2, block_ints);
+	KeyGroup group(arity2, group_tuples, block_ints);
+	bool done = false;
+	std::size_t steps = 0;
+	// counts a step of the merge, and tells whether the join must stop
+	auto poll = [&]() { return stopped && ++steps % POLL_INTERVAL == 0 && stopped(); };
+	while (!done && !stream1.empty() && !stream2.empty()) {
+		if (poll())
+			break;
+		int comp = compare_assignments(stream1.top(), matching1, stream2.top(), matching2);
+		if (comp < 0) stream1.pop();
+		else if (comp > 0) stream2.pop();
+		else {
+			group.clear();
+			do {
+				group.add(stream2.top());
+				stream2.pop();
+			} while (!stream2.empty() &&
+				 compare_assignments(group.front(), matching2, stream2.top(), matching2) == 0);
+			group.close();
+
+			do {
+				group.for_each([&](const tuple_t& tpl2) {
+					auto tpl = merge_reduce_tpls(stream1.top(), tpl2, vars1, vars2, unique_vars);
+					if (selection(tpl)) {
+						join_rel.push_tuple(std::move(tpl));
+						done = (join_rel.size() == limit);
+					}
+					return !done;
+				});
+				stream1.pop();
+				done = done || poll();
+			} while (!done && !stream1.empty() &&
+				 compare_assignments(stream1.top(), matching1, group.front(), matching2) == 0);
+		}
+	}
+	join_rel.set_order(join_output_order(less1.perm, vars1, unique_vars));
+
+	return join_rel;
+}
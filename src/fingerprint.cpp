@@ -0,0 +1,71 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <vector>
+#include "communicator.h"
+#include "fingerprint.h"
+#include "mpiutil.h"
+
+static_assert(sizeof(std::size_t) == sizeof(std::uint64_t), "the sums are reduced as size_t");
+
+/* finalizer of splitmix64, a bijection of 64-bit words with full avalanche */
+static std::uint64_t mix(std::uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* hash of a tuple, chained over its values so that their positions matter */
+static std::uint64_t tuple_hash(const Relation<int>::tuple_t& tpl, std::uint64_t seed)
+{
+	std::uint64_t h = mix(seed + tpl.size());
+	for (int x : tpl)
+		h = mix(h ^ (std::uint32_t) x);
+	return h;
+}
+
+Fingerprint fingerprint(Relation<int>& rel)
+{
+	Fingerprint fp{0, 0, 0};
+	for (auto& tpl : rel) {
+		fp.count++;
+		fp.sum1 += tuple_hash(tpl, 0x9e3779b97f4a7c15ull);
+		fp.sum2 += tuple_hash(tpl, 0xc2b2ae3d27d4eb4full);
+	}
+
+	return fp;
+}
+
+Fingerprint distributed_fingerprint(Relation<int>& part)
+{
+	Fingerprint fp = fingerprint(part);
+	std::vector<std::size_t> sums{fp.count, fp.sum1, fp.sum2};
+	current_communicator().reduce(sums, ReduceOp::Sum, constants::ROOT);
+
+	return Fingerprint{sums[0], sums[1], sums[2]};
+}
+
+bool operator==(const Fingerprint& a, const Fingerprint& b)
+{
+	return a.count == b.count && a.sum1 == b.sum1 && a.sum2 == b.sum2;
+}
+
+std::ostream& operator<<(std::ostream& os, const Fingerprint& fp)
+{
+	auto flags = os.flags();
+	os << fp.count << " " << std::hex << fp.sum1 << " " << fp.sum2;
+	os.flags(flags);
+	return os;
+}
+
+std::istream& operator>>(std::istream& is, Fingerprint& fp)
+{
+	auto flags = is.flags();
+	is >> fp.count >> std::hex >> fp.sum1 >> fp.sum2;
+	is.flags(flags);
+	return is;
+}
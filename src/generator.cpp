@@ -0,0 +1,100 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+#include "generator.h"
+
+using edges_t = std::vector<std::pair<int, int>>;
+
+/*
+ * Builds the relation of a graph from a list of edges: self-loops and
+ * duplicates are dropped, and each edge is stored in both directions
+ */
+static Relation<int> graph_relation(edges_t& edges)
+{
+	edges_t both;
+	both.reserve(2 * edges.size());
+	for (auto& edge : edges)
+		if (edge.first != edge.second) {
+			both.emplace_back(edge.first, edge.second);
+			both.emplace_back(edge.second, edge.first);
+		}
+	edges.clear();
+	std::sort(both.begin(), both.end());
+	both.erase(std::unique(both.begin(), both.end()), both.end());
+
+	Relation<int> graph(2);
+	for (auto& edge : both)
+		graph.push_tuple({edge.first, edge.second});
+	graph.set_order({0, 1});
+
+	return graph;
+}
+
+Relation<int> erdos_renyi_graph(int n, std::size_t m, std::uint64_t seed)
+{
+	std::mt19937_64 random(seed);
+	std::uniform_int_distribution<int> vertex(0, n - 1);
+	edges_t edges(m);
+	for (auto& edge : edges)
+		edge = std::make_pair(vertex(random), vertex(random));
+
+	return graph_relation(edges);
+}
+
+Relation<int> rmat_graph(int scale, std::size_t m, double a, double b, double c, std::uint64_t seed)
+{
+	std::mt19937_64 random(seed);
+	std::uniform_real_distribution<double> coin(0, 1);
+	edges_t edges(m);
+	for (auto& edge : edges) {
+		int u = 0, v = 0;
+		for (int bit = scale - 1; bit >= 0; bit--) {
+			double x = coin(random);
+			if (x >= a + b + c)	u |= 1 << bit, v |= 1 << bit;
+			else if (x >= a + b)	u |= 1 << bit;
+			else if (x >= a)	v |= 1 << bit;
+		}
+		edge = std::make_pair(u, v);
+	}
+
+	return graph_relation(edges);
+}
+
+Relation<int> barabasi_albert_graph(int n, int k, std::uint64_t seed)
+{
+	std::mt19937_64 random(seed);
+	edges_t edges;
+	// every vertex appears once per incident edge, so that a uniform
+	// choice among endpoints is proportional to the degree
+	std::vector<int> endpoints;
+	for (int u = 0; u <= k && u < n; u++)
+		for (int v = 0; v < u; v++) {
+			edges.emplace_back(u, v);
+			endpoints.push_back(u);
+			endpoints.push_back(v);
+		}
+
+	std::vector<int> targets;
+	for (int u = k + 1; u < n; u++) {
+		targets.clear();
+		while ((int) targets.size() < k) {
+			int v = endpoints[std::uniform_int_distribution<std::size_t>(0, endpoints.size() - 1)(random)];
+			if (std::find(targets.begin(), targets.end(), v) == targets.end())
+				targets.push_back(v);
+		}
+		for (int v : targets) {
+			edges.emplace_back(u, v);
+			endpoints.push_back(u);
+			endpoints.push_back(v);
+		}
+	}
+
+	return graph_relation(edges);
+}
@@ -0,0 +1,161 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <malloc.h>
+#include "communicator.h"
+#include "memstats.h"
+#include "mpiutil.h"
+#include "settings.h"
+
+static const char* phase_names[NUM_PHASES] = {"read", "partition", "shuffle", "sort", "join", "gather", "aggregate"};
+
+const char* phase_name(Phase phase)
+{
+	return phase_names[static_cast<int>(phase)];
+}
+
+/* bytes allocated by the process, and their highest value */
+static std::atomic<long long> allocated{0};
+static std::atomic<long long> highest{0};
+
+/* highest value of allocated seen by this thread in its current phase */
+static thread_local long long thread_peak = 0;
+/* high-water mark of every phase for this thread */
+static thread_local std::size_t phase_peaks[NUM_PHASES];
+
+static void count_bytes(long long delta)
+{
+	long long now = allocated.fetch_add(delta, std::memory_order_relaxed) + delta;
+	if (delta <= 0)
+		return;
+
+	thread_peak = std::max(thread_peak, now);
+	long long peak = highest.load(std::memory_order_relaxed);
+	while (now > peak && !highest.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+		;
+}
+
+void* operator new(std::size_t size)
+{
+	void* ptr;
+	while (!(ptr = std::malloc(size ? size : 1))) {
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+	// the usable size is what operator delete will give back
+	if (settings::report_memory)
+		count_bytes(malloc_usable_size(ptr));
+
+	return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	try {
+		return operator new(size);
+	} catch (std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr && settings::report_memory)
+		count_bytes(-(long long) malloc_usable_size(ptr));
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	operator delete(ptr);
+}
+
+/* blocks allocated before the accounting started may be freed after it */
+static std::size_t clamp(long long bytes)
+{
+	return bytes > 0 ? (std::size_t) bytes : 0;
+}
+
+std::size_t current_memory()
+{
+	return clamp(allocated.load(std::memory_order_relaxed));
+}
+
+std::size_t peak_memory()
+{
+	return clamp(highest.load(std::memory_order_relaxed));
+}
+
+MemoryPhase::MemoryPhase(Phase p) : phase{p}, outer_peak{clamp(thread_peak)}
+{
+	thread_peak = allocated.load(std::memory_order_relaxed);
+}
+
+MemoryPhase::~MemoryPhase()
+{
+	std::size_t peak = clamp(thread_peak);
+	auto& phase_peak = phase_peaks[static_cast<int>(phase)];
+	phase_peak = std::max(phase_peak, peak);
+	thread_peak = std::max(outer_peak, peak);
+}
+
+void report_memory(std::ostream& os)
+{
+	Communicator& world = current_communicator();
+	int nprocs = world.size();
+
+	// row of this process: the peak of each phase, then the overall one
+	const int row = NUM_PHASES + 1;
+	std::vector<std::size_t> table(nprocs * row, 0);
+	std::copy(phase_peaks, phase_peaks + NUM_PHASES, table.begin() + world.rank() * row);
+	table[world.rank() * row + NUM_PHASES] = peak_memory();
+	world.reduce(table, ReduceOp::Sum, constants::ROOT);
+
+	if (world.rank() != constants::ROOT)
+		return;
+	for (int phase = 0; phase < row; phase++) {
+		std::size_t max = 0, sum = 0;
+		for (int proc = 0; proc < nprocs; proc++) {
+			max = std::max(max, table[proc * row + phase]);
+			sum += table[proc * row + phase];
+		}
+		if (max == 0)
+			continue;
+
+		os << "memory " << (phase < NUM_PHASES ? phase_name(static_cast<Phase>(phase)) : "peak")
+		   << ": max " << max << " bytes, avg " << sum / nprocs << " bytes, per process";
+		for (int proc = 0; proc < nprocs; proc++)
+			os << " " << table[proc * row + phase];
+		os << std::endl;
+	}
+}
@@ -4,141 +4,854 @@
  * Victor Hugo V. Silva (vitorvianna10@gmail.com)
  */
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <functional>
-#include <boost/mpi.hpp>
-#include <boost/mpi/collectives.hpp>
+#include "catalog.h"
+#include "communicator.h"
+#include "predicate.h"
 #include "ioutil.h"
 #include "mpiutil.h"
 #include "util.h"
 #include "hash.h"
+#include "profile.h"
 #include "debug.h"
+#include "settings.h"
 #include "MurmurHash3.h"
 
 /*
  * This function takes a relation of integer tuples and divides it
- * into nproc relations, where nproc is the number of processes.
- * A tuple tpl is assigned to a certain relation according to a 
- * reference variable of the tuple (coord) and a given hash function.
+ * into nparts relations (usually the number of processes, more when
+ * over-partitioning). A tuple tpl is assigned to a certain relation according to a 
+ * reference key of the tuple (the values at coords) and a given
+ * hash function.
  *
  * @param rel original relation to be divided into nproc relations
- * @param coord coordinate according to which the tuples will be
- * 	  assigned to the different processes
- * @param hash_method hash function used by the algorithm
+ * @param coords coordinates according to which the tuples will be
+ * 	  assigned to the different processes; if empty, every tuple
+ * 	  is assigned to constants::ROOT
+ * @param hash hash function used by the algorithm (see hash.h)
+ * @param nparts number of relations to produce
  * @result a vector of truple whose concatenation is equal to the
  * 	   original relation
  */
-std::vector<Relation<int>> divide_tuples(Relation<int> &rel, int coord, HashMethod hash_method)
+template<typename Hash>
+std::vector<Relation<int>> divide_tuples(Relation<int> &rel, const std::vector<int>& coords, const Hash& hash, int nparts)
 {
-	mpi::communicator world;
-	int world_size = world.size();
-
-	std::vector<Relation<int>> division_vector(world_size, Relation<int>(rel.get_arity()));
+	std::vector<Relation<int>> division_vector(nparts, Relation<int>(rel.get_arity()));
 	
-	if(coord==constants::NONE) // send every tuple to constants::ROOT
+	if(coords.empty()) // send every tuple to constants::ROOT
 		division_vector[constants::ROOT] = rel;
 	else{
-		for (auto it = rel.begin(); it != rel.end(); it++) {
-			int dst_id;
-			switch(hash_method)
-			{
-				case HashMethod::ModHash:
-			 		dst_id=mod_hash((*it)[coord], world_size);
-			 		break;
-			 	case HashMethod::MultHash:
-			 		dst_id=mult_hash((*it)[coord], world_size);
-			 		break;
-			 	case HashMethod::MurmurHash:
-			 		dst_id=murmur_hash((*it)[coord], world_size);
-			 		break;
-			 	default:
-			 		throw("Invalid hash method");
-			 		break;			
-			}
-			division_vector[dst_id].push_tuple(*it);
-		}	
+		// hash all the keys in one batch, then distribute the tuples
+		std::vector<unsigned> keys, dst_ids(rel.size());
+		keys.reserve(rel.size());
+		for (auto it = rel.begin(); it != rel.end(); it++)
+			keys.push_back(combine_keys(*it, coords));
+		hash_batch(hash, keys.data(), keys.size(), nparts, dst_ids.data());
+
+		auto dst_it = dst_ids.begin();
+		for (auto it = rel.begin(); it != rel.end(); it++, dst_it++)
+			division_vector[*dst_it].push_tuple(*it);
 	}
+	// every part keeps the order of the relation
+	for (auto& part : division_vector)
+		part.set_order(rel.get_order());
 	
 
 	return division_vector;
 }
 
-template<typename T>
-struct concatenate_functor
+/* selects the hash function, of the given seed, once for the whole relation */
+std::vector<Relation<int>> divide_tuples(Relation<int> &rel, const std::vector<int>& coords, HashMethod hash_method,
+					 int nparts, std::uint32_t seed)
+{
+	PhaseScope phase(Phase::Partition);
+	switch(hash_method)
+	{
+		case HashMethod::ModHash:
+	 		return divide_tuples(rel, coords, ModHash(seed), nparts);
+	 	case HashMethod::MultHash:
+	 		return divide_tuples(rel, coords, MultHash(seed), nparts);
+	 	case HashMethod::MurmurHash:
+	 		return divide_tuples(rel, coords, MurmurHash(seed), nparts);
+	 	case HashMethod::TabulationHash:
+	 		return divide_tuples(rel, coords, TabulationHash(seed), nparts);
+	 	default:
+	 		throw("Invalid hash method");
+	}
+}
+
+/* number of keys sampled per part when choosing splitters */
+static const std::size_t OVERSAMPLING = 32;
+
+/*
+ * Returns the sampling stride (one tuple sampled in stride) that
+ * yields OVERSAMPLING keys per part out of total tuples
+ */
+static int sample_stride(std::size_t total, int nparts)
+{
+	return (int) std::max<std::size_t>(1, total / (OVERSAMPLING * nparts));
+}
+
+/*
+ * Samples the keys (the values at coords) of one tuple in stride
+ *
+ * @param rel relation to sample
+ * @param coords coordinates of the key
+ * @param stride sampling stride
+ * @return the sampled keys, as a sorted relation of arity coords.size()
+ */
+static Relation<int> sample_keys(Relation<int>& rel, const std::vector<int>& coords, int stride)
+{
+	Relation<int> samples(std::max<std::size_t>(coords.size(), 1));
+	if (coords.empty())
+		return samples;
+
+	std::size_t i = 0;
+	for (auto& tpl : rel)
+		if (i++ % stride == 0) {
+			Relation<int>::tuple_t key;
+			for (int coord : coords)
+				key.push_back(tpl[coord]);
+			samples.push_tuple(key);
+		}
+
+	std::vector<int> identity(coords.size());
+	for (std::size_t j = 0; j < identity.size(); j++)
+		identity[j] = j;
+	sort(samples, identity);
+
+	return samples;
+}
+
+/*
+ * Chooses nparts - 1 splitters, evenly spaced quantiles of the sampled
+ * keys. A key frequent enough to span several quantiles is repeated,
+ * once per quantile, and divide_by_range spreads it over the ranges
+ * of these quantiles.
+ *
+ * @param samples sampled keys (sorted by this function)
+ * @param nparts number of ranges
+ * @return the splitters, in increasing order, one key after the other
+ */
+static std::vector<int> choose_splitters(Relation<int>& samples, int nparts)
+{
+	std::vector<int> splitters;
+	if (samples.size() == 0)
+		return splitters;
+
+	std::vector<int> identity(samples.get_arity());
+	for (std::size_t j = 0; j < identity.size(); j++)
+		identity[j] = j;
+	sort(samples, identity);
+
+	auto& keys = samples.flatten();
+	for (int i = 1; i < nparts; i++) {
+		auto& key = keys[i * keys.size() / nparts];
+		splitters.insert(splitters.end(), key.begin(), key.end());
+	}
+
+	return splitters;
+}
+
+/*
+ * Divides a relation into nparts ranges of keys: part i receives the
+ * tuples whose key (the values at coords) is at least splitter i - 1
+ * and less than splitter i. A key equal to splitters j to k - 1 spans
+ * the quantiles of parts j to k, and would leave parts j + 1 to k - 1
+ * empty and all its tuples on part k: its tuples go to parts j to k
+ * instead, spread round-robin on one side of the join and copied to
+ * each of them on the other side, so that every pair of matching
+ * tuples still meets on a part. The parts
+ * keep the order of the relation, so parts sorted on the key
+ * concatenate into a sorted relation.
+ *
+ * @param rel relation to divide
+ * @param coords coordinates of the key; if empty, every tuple is
+ * 	  assigned to constants::ROOT
+ * @param splitters non-decreasing keys, one after the other (see choose_splitters)
+ * @param nparts number of relations to produce
+ * @param copy_heavy whether the tuples of a key equal to splitters are
+ * 	  copied to its parts (true) or spread over them (false)
+ * @return the ranges, in increasing order
+ */
+static std::vector<Relation<int>> divide_by_range(Relation<int>& rel, const std::vector<int>& coords,
+						  const std::vector<int>& splitters, int nparts, bool copy_heavy)
+{
+	PhaseScope phase(Phase::Partition);
+	std::vector<Relation<int>> division(nparts, Relation<int>(rel.get_arity()));
+	if (coords.empty()) {
+		division[constants::ROOT] = rel;
+		return division;
+	}
+
+	std::size_t key_size = coords.size(), nsplitters = splitters.size() / key_size;
+	auto compare = [&](const Relation<int>::tuple_t& tpl, std::size_t splitter) {
+		for (std::size_t i = 0; i < key_size; i++) {
+			int value = splitters[splitter * key_size + i];
+			if (tpl[coords[i]] != value)
+				return tpl[coords[i]] < value ? -1 : 1;
+		}
+		return 0;
+	};
+	// binary search of the first splitter greater than the key (or not less, if !strict)
+	auto bound = [&](const Relation<int>::tuple_t& tpl, bool strict) {
+		std::size_t low = 0, high = nsplitters;
+		while (low < high) {
+			std::size_t mid = (low + high) / 2;
+			int comp = compare(tpl, mid);
+			if (comp > 0 || (strict && comp == 0))
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		return low;
+	};
+	std::size_t spread = 0; // the parts of a key equal to splitters are taken in turn
+	for (auto& tpl : rel) {
+		std::size_t first = bound(tpl, false), last = bound(tpl, true);
+		if (first == last)
+			division[last].push_tuple(tpl);
+		else if (copy_heavy)
+			for (std::size_t part = first; part <= last; part++)
+				division[part].push_tuple(tpl);
+		else
+			division[first + spread++ % (last - first + 1)].push_tuple(tpl);
+	}
+	for (auto& part : division)
+		part.set_order(rel.get_order());
+
+	return division;
+}
+
+/*
+ * Returns the coordinates of the variables key_vars in a tuple of
+ * variables vars (first occurrence of each one)
+ *
+ * @param vars variables of the tuple
+ * @param key_vars variables forming the key, all present in vars
+ * @return coordinates of key_vars in vars, in the same order
+ */
+static std::vector<int> key_coords(const std::vector<int>& vars, const std::vector<int>& key_vars)
+{
+	std::vector<int> coords;
+	for (int var : key_vars)
+		coords.push_back(std::find(vars.begin(), vars.end(), var) - vars.begin());
+
+	return coords;
+}
+
+/*
+ * Checks whether a partitioning on key_vars can be kept for a join
+ * on common_vars: tuples agreeing on common_vars must agree on the
+ * key, i.e. the key must be a non-empty subset of common_vars.
+ */
+static bool partitioning_valid(const std::vector<int>& key_vars, const std::vector<int>& common_vars)
+{
+	if (key_vars.empty())
+		return false;
+	for (int var : key_vars)
+		if (std::find(common_vars.begin(), common_vars.end(), var) == common_vars.end())
+			return false;
+
+	return true;
+}
+
+/*
+ * Identifies, in a catalog key, the selection applied to a relation
+ * before it is divided: the length of its encoding, then the encoding
+ *
+ * @param vars variables of the relation
+ * @param predicates predicates of the query
+ */
+static std::vector<int> selection_key(const std::vector<int>& vars, const std::vector<Predicate>& predicates)
+{
+	auto key = Selection(bound_predicates(predicates, vars), vars).key();
+	key.insert(key.begin(), (int) key.size());
+	return key;
+}
+
+/*
+ * Divider of the relation catalog that selects the tuples satisfying
+ * the predicates bound by vars, then divides them
+ *
+ * @param vars variables of the relation
+ * @param predicates predicates of the query
+ * @param divide divider of the selected tuples
+ */
+static RelationCatalog::divider_t selecting(const std::vector<int>& vars, const std::vector<Predicate>& predicates,
+					    const RelationCatalog::divider_t& divide)
+{
+	return [&vars, &predicates, divide](Relation<int>& rel) {
+		if (bound_predicates(predicates, vars).empty())
+			return divide(rel);
+		Relation<int> selected(rel);
+		select_tuples(selected, vars, predicates);
+		return divide(selected);
+	};
+}
+
+/*
+ * Returns the statistics of every shuffle this process (or thread,
+ * for the shared-memory backend) took part in, in execution order.
+ */
+std::vector<ShuffleStats>& shuffle_log()
+{
+	static thread_local std::vector<ShuffleStats> log;
+	return log;
+}
+
+/*
+ * Computes the statistics of handing the relations in rels to
+ * the network, before any encoding.
+ */
+static ShuffleStats shuffle_stats(const std::vector<Relation<int>*>& rels)
+{
+	ShuffleStats stats{0, 0, 0, 0, 0};
+	for (auto rel : rels) {
+		stats.tuples += rel->size();
+		stats.raw_bytes += wire_size(*rel);
+	}
+
+	return stats;
+}
+
+/*
+ * Scatters the relations in division from the root process: process i
+ * receives division[i] into subrel.
+ *
+ * @param world communicator
+ * @param division one relation per process (only read on root, and
+ * 	possibly consumed)
+ * @param subrel relation receiving the part of this process
+ * @param root process holding the division
+ */
+static void scatter_relations(Communicator& world,
+			      std::vector<Relation<int>>& division,
+			      Relation<int>& subrel, int root)
+{
+	PhaseScope phase(Phase::Shuffle);
+	std::vector<Relation<int>*> sent;
+	if (world.rank() == root)
+		for (auto& rel : division)
+			sent.push_back(&rel);
+
+	ShuffleStats stats = shuffle_stats(sent);
+	stats.sent_bytes = world.scatter(division, subrel, root);
+	stats.received = subrel.size();
+	stats.received_bytes = wire_size(subrel);
+	shuffle_log().push_back(stats);
+}
+
+/*
+ * Gathers the relations rel of every process into result, on the
+ * root process, by concatenation (by a k-way merge if the parts
+ * are sorted the same way, see merge_sorted).
+ *
+ * @param world communicator
+ * @param rel part of this process (possibly consumed)
+ * @param result concatenation of all parts (only written on root)
+ * @param root process receiving the result
+ * @param phase phase of the algorithm, for memory and time accounting: the
+ * 	final gather of a result, or a shuffle between two joins
+ */
+static void gather_relations(Communicator& world, Relation<int>& rel,
+			     Relation<int>& result, int root, Phase phase = Phase::Gather)
+{
+	PhaseScope phase_scope(phase);
+	ShuffleStats stats = shuffle_stats({&rel});
+	std::vector<Relation<int>> parts;
+	stats.sent_bytes = world.gather(rel, parts, root);
+
+	if (world.rank() == root)
+		result = merge_sorted(parts);
+	stats.received = (world.rank() == root) ? result.size() : 0;
+	stats.received_bytes = (world.rank() == root) ? wire_size(result) : 0;
+	shuffle_log().push_back(stats);
+}
+
+/*
+ * Replicates the relation rel of the root process on every process.
+ *
+ * @param world communicator
+ * @param rel relation to replicate (overwritten on every other process)
+ * @param root process holding the relation
+ */
+static void broadcast_relation(Communicator& world, Relation<int>& rel, int root)
+{
+	PhaseScope phase(Phase::Shuffle);
+	// the root sends its relation to each one of the other processes
+	std::vector<Relation<int>*> sent;
+	if (world.rank() == root)
+		sent.assign(world.size() - 1, &rel);
+
+	ShuffleStats stats = shuffle_stats(sent);
+	stats.sent_bytes = world.broadcast(rel, root);
+	stats.received = rel.size();
+	stats.received_bytes = wire_size(rel);
+	shuffle_log().push_back(stats);
+}
+
+/*
+ * Last step of the algorithms: gathers the parts of the result on the
+ * root, or leaves each part where it is (every process then returns
+ * its own part, and the parts partition the result)
+ *
+ * @param world communicator
+ * @param part part of this process (consumed)
+ * @param gather whether the parts are gathered on the root
+ * @param limit at most limit tuples are returned (0: all of them); a
+ * 	  result left in parts may have up to limit tuples per process
+ * @return the result on the root, or the part of this process
+ */
+static Relation<int> collect_result(Communicator& world, Relation<int>& part, bool gather, std::size_t limit)
+{
+	Relation<int> result;
+	if (gather)
+		gather_relations(world, part, result, constants::ROOT);
+	else
+		result = std::move(part);
+	if (limit > 0)
+		result.truncate(limit);
+
+	return result;
+}
+
+/*
+ * Group-by aggregation of a result spread over the processes (see
+ * GroupBy): every process aggregates its part, the partial aggregates
+ * are partitioned on the group variables, and every process combines
+ * those of its groups. Only one tuple per group and process crosses
+ * the network. The groups are then collected like the result of a
+ * join (see collect_result).
+ *
+ * @param world communicator
+ * @param part part of the result held by this process (consumed)
+ * @param vars variables of the result, replaced by those of the groups
+ * @param group_by aggregation
+ * @param hash_method hash function of the partitioning of the groups
+ * @param limit at most limit groups are returned (0: all of them)
+ * @return the groups
+ */
+static Relation<int> aggregate_result(Communicator& world, Relation<int>& part, std::vector<int>& vars,
+				      const GroupBy& group_by, HashMethod hash_method, std::size_t limit)
+{
+	Relation<int> partials = aggregate_groups(part, vars, group_by);
+	std::vector<int> group_coords(group_by.group_vars.size());
+	for (std::size_t i = 0; i < group_coords.size(); i++)
+		group_coords[i] = i;
+	// sorted on the group, like the parts, so that each process merges what it receives
+	auto divided = divide_tuples(partials, group_coords, hash_method, world.size(), settings::hash_seed);
+	partials.clear();
+	for (int i = 0; i < world.size(); i++)
+		gather_relations(world, divided[i], partials, i, Phase::Shuffle);
+
+	Relation<int> groups = combine_groups(partials, group_by);
+	vars = aggregate_vars(group_by, vars);
+	return collect_result(world, groups, settings::gather_result, limit);
+}
+
+/*
+ * Duplicate elimination of a result spread over the processes (see
+ * settings::distinct_result): every process drops the duplicates of its
+ * part, the parts are partitioned on every column, so that equal tuples
+ * meet on the same process, which drops them again. The distinct tuples
+ * are then collected like the result of a join (see collect_result).
+ *
+ * @param world communicator
+ * @param part part of the result held by this process (consumed)
+ * @param hash_method hash function of the partitioning of the tuples
+ * @param limit at most limit tuples are returned (0: all of them)
+ * @return the distinct tuples
+ */
+static Relation<int> distinct_result(Communicator& world, Relation<int>& part, HashMethod hash_method,
+				     std::size_t limit)
+{
+	std::vector<Relation<int>> divided;
+	{
+		PhaseScope phase(Phase::Aggregate);
+		distinct(part);
+		std::vector<int> coords(part.get_arity());
+		for (std::size_t i = 0; i < coords.size(); i++)
+			coords[i] = i;
+		// sorted, like the parts, so that each process merges what it receives
+		divided = divide_tuples(part, coords, hash_method, world.size(), settings::hash_seed);
+	}
+	Relation<int> unique_part(part.get_arity());
+	for (int i = 0; i < world.size(); i++)
+		gather_relations(world, divided[i], unique_part, i, Phase::Shuffle);
+	{
+		PhaseScope phase(Phase::Aggregate);
+		distinct(unique_part);
+	}
+
+	return collect_result(world, unique_part, settings::gather_result, limit);
+}
+
+/*
+ * Splits a relation into nparts blocks of consecutive tuples whose
+ * sizes differ by at most one
+ *
+ * @param rel relation to split
+ * @param nparts number of blocks
+ * @return the blocks, in order
+ */
+static std::vector<Relation<int>> divide_evenly(Relation<int>& rel, int nparts)
+{
+	PhaseScope phase(Phase::Partition);
+	std::vector<Relation<int>> division(nparts, Relation<int>(rel.get_arity()));
+	std::size_t i = 0;
+	for (auto& tpl : rel)
+		division[i++ * nparts / rel.size()].push_tuple(tpl);
+	for (auto& part : division)
+		part.set_order(rel.get_order());
+
+	return division;
+}
+
+/*
+ * Decides whether a relation of small_size tuples should be replicated
+ * on every process rather than joined by hash partitioning with one of
+ * large_size tuples, i.e. whether nprocs * small_size is below
+ * settings::broadcast_threshold * large_size.
+ */
+static bool replicate_small(std::size_t small_size, std::size_t large_size, int nprocs)
+{
+	return settings::broadcast_threshold > 0 && nprocs > 1 &&
+		(double) small_size * nprocs < settings::broadcast_threshold * large_size;
+}
+
+/*
+ * Sums the shuffle statistics of all processes and prints, on the
+ * root, one line per shuffle with its compression ratio and the
+ * largest number of tuples received by a single process.
+ * Must be called by every process.
+ *
+ * @param os stream where the report is written
+ */
+void report_shuffles(std::ostream& os)
 {
-	Relation<T>& operator()(Relation<T> &r1, Relation<T> &r2) {
-		return r1.concatenate(r2);
+	Communicator& world = current_communicator();
+
+	std::vector<std::size_t> total, max_received;
+	for (auto& stats : shuffle_log()) {
+		total.push_back(stats.tuples);
+		total.push_back(stats.raw_bytes);
+		total.push_back(stats.sent_bytes);
+		max_received.push_back(stats.received);
+	}
+	world.reduce(total, ReduceOp::Sum, constants::ROOT);
+	world.reduce(max_received, ReduceOp::Max, constants::ROOT);
+
+	if (world.rank() != constants::ROOT)
+		return;
+	for (std::size_t i = 0; i < max_received.size(); i++) {
+		std::size_t tuples = total[3 * i], raw = total[3 * i + 1], sent = total[3 * i + 2];
+		os << "shuffle " << i << ": " << tuples << " tuples, "
+		   << raw << " bytes raw, " << sent << " bytes sent";
+		if (sent > 0)
+			os << " (ratio " << (double) raw / sent << ")";
+		os << ", max load " << max_received[i] << " tuples" << std::endl;
+	}
+}
+
+/* tags of the messages of join_partitions_dynamically */
+namespace tags {
+	const int REQUEST = 1; // a process asks the root for work
+	const int TASK = 2; // the root answers with a partition index (or -1) and two relations
+	const int LIMIT = 3; // a process found enough tuples for a query with a limit
+}
+
+/*
+ * Early termination of the last join of a query with a limit. A
+ * process that produces limit tuples by itself has found enough for
+ * everyone: it tells every other process so, without waiting for an
+ * answer, and the others poll for that message while joining and give
+ * up. finish then agrees, collectively, on how many messages were
+ * sent, and receives the ones not read yet so that none is left for
+ * later operations. Without a limit, nothing is sent nor polled.
+ */
+class EarlyTermination {
+private:
+	Communicator& world;
+	std::size_t limit;
+	bool notified; // this process found enough tuples and told the others
+	bool stop;
+public:
+	EarlyTermination(Communicator& w, std::size_t l)
+		: world(w), limit{l}, notified{false}, stop{false} {}
+
+	/* whether enough tuples were found, here or by another process */
+	bool stopped()
+	{
+		if (!stop && limit > 0 && world.probe(tags::LIMIT))
+			stop = true;
+		return stop;
+	}
+
+	/* stopping condition to hand over to join */
+	std::function<bool()> poll()
+	{
+		if (limit == 0)
+			return std::function<bool()>();
+		return [this]() { return stopped(); };
+	}
+
+	/* records that this process produced count tuples so far */
+	void produced(std::size_t count)
+	{
+		if (limit == 0 || count < limit || notified)
+			return;
+		notified = stop = true;
+		for (int i = 0; i < world.size(); i++)
+			if (i != world.rank())
+				world.send(1, i, tags::LIMIT);
+	}
+
+	/* number of tuples still wanted, given count tuples produced (0: no limit) */
+	std::size_t remaining(std::size_t count) const
+	{
+		return limit == 0 ? 0 : limit - count;
+	}
+
+	/* must be called by every process once the join is over */
+	void finish()
+	{
+		if (limit == 0)
+			return;
+		std::vector<std::size_t> notifiers{notified ? 1u : 0u};
+		world.reduce(notifiers, ReduceOp::Sum, constants::ROOT);
+		int messages = notifiers.front();
+		world.broadcast(messages, constants::ROOT);
+		for (int i = notified ? 1 : 0, value; i < messages; i++)
+			world.recv(value, Communicator::any_source, tags::LIMIT);
 	}
 };
 
 /*
- * Specialization of functor to allow
- * faster reduce algorithm
+ * Joins the virtual partitions parts1[i] and parts2[i], held by the
+ * root, handing them out on demand: every process asks the root for a
+ * new pair as soon as it is done with the previous one, so fast
+ * processes take over the work that slow ones have not started.
+ * Largest pairs are handed out first. The root joins pairs too,
+ * starting from the smallest ones, and serves the requests that arrive
+ * meanwhile whenever its join polls its stopping condition (see join),
+ * so that the other processes do not wait for the end of its join;
+ * only the sort of a pair, which is not polled, delays them.
+ *
+ * @param world communicator
+ * @param parts1 virtual partitions of the first relation (root only)
+ * @param parts2 virtual partitions of the second relation (root only)
+ * @param vars1 tuple of variables for first relation
+ * @param vars2 tuple of variables for second relation
+ * @param termination early termination of a join with a limit; once
+ * 	  it is stopped, pending pairs are dropped
+ * @param predicates predicates of the query (see join)
+ * @return concatenation of the joins computed by this process
  */
-namespace boost { namespace mpi {
-	template<typename T>
-	struct is_commutative<concatenate_functor<T>, Relation<T> >
-	: mpl::true_ { };
-} }
+static Relation<int> join_partitions_dynamically(Communicator& world,
+						 std::vector<Relation<int>>& parts1,
+						 std::vector<Relation<int>>& parts2,
+						 std::vector<int>& vars1,
+						 std::vector<int>& vars2,
+						 EarlyTermination& termination,
+						 const std::vector<Predicate>& predicates)
+{
+	Relation<int> result(get_unique_vars(vars1, vars2).size());
+	ShuffleStats stats{0, 0, 0, 0, 0};
+	auto join_pair = [&](Relation<int>& sub1, Relation<int>& sub2, const std::function<bool()>& stopped) {
+		stats.received += sub1.size() + sub2.size();
+		stats.received_bytes += wire_size(sub1) + wire_size(sub2);
+		if (termination.stopped())
+			return;
+		auto partial_result = join(sub1, sub2, vars1, vars2,
+					   termination.remaining(result.size()), stopped, predicates);
+		result.concatenate(partial_result);
+		termination.produced(result.size());
+	};
+
+	if (world.rank() != constants::ROOT) {
+		for (int task;;) {
+			world.send(world.rank(), constants::ROOT, tags::REQUEST);
+			world.recv(task, constants::ROOT, tags::TASK);
+			if (task < 0)
+				break;
+			Relation<int> sub1, sub2;
+			{
+				PhaseScope phase(Phase::Shuffle);
+				world.recv(sub1, constants::ROOT, tags::TASK);
+				world.recv(sub2, constants::ROOT, tags::TASK);
+			}
+			join_pair(sub1, sub2, termination.poll());
+		}
+		shuffle_log().push_back(stats);
+		return result;
+	}
+
+	// pending pairs, largest first
+	std::vector<int> order(parts1.size());
+	for (std::size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](int a, int b) {
+		return parts1[a].size() + parts2[a].size() > parts1[b].size() + parts2[b].size(); });
+	std::size_t front = 0, back = order.size();
+
+	// answers the request of process src with the largest pending pair
+	int working = world.size() - 1;
+	auto serve = [&](int src) {
+		if (front == back) {
+			world.send(-1, src, tags::TASK);
+			working--;
+			return;
+		}
+		int task = order[front++];
+		PhaseScope phase(Phase::Shuffle);
+		world.send(task, src, tags::TASK);
+		for (Relation<int>* sub : {&parts1[task], &parts2[task]}) {
+			stats.tuples += sub->size();
+			stats.raw_bytes += wire_size(*sub);
+			stats.sent_bytes += world.send(*sub, src, tags::TASK);
+		}
+	};
+
+	// serves the pending requests, dropping the pending pairs once the join is stopped
+	std::function<bool()> serve_pending = [&]() {
+		if (termination.stopped())
+			back = front;
+		int requester;
+		while (world.probe(tags::REQUEST))
+			serve(world.recv(requester, Communicator::any_source, tags::REQUEST));
+		return termination.stopped();
+	};
+
+	while (working > 0 || front < back) {
+		serve_pending();
+		if (front < back) {
+			back--;
+			join_pair(parts1[order[back]], parts2[order[back]], serve_pending);
+		} else if (working > 0) {
+			int requester;
+			serve(world.recv(requester, Communicator::any_source, tags::REQUEST));
+		}
+	}
+	shuffle_log().push_back(stats);
+
+	return result;
+}
 
 /* Performs join operation in a distributed fashion
  * using Boost's MPI interface.
+ * Both relations are hash partitioned on their common variables,
+ * unless one of them is small enough to be replicated on every
+ * process (see settings::broadcast_threshold), in which case the
+ * other one is split evenly without looking at its values.
+ * With settings::overpartition > 1, the hash partitions are that many
+ * times more numerous than the processes and are handed out on demand
+ * (see join_partitions_dynamically). With settings::range_partition,
+ * partitions are ranges of the join key instead, so that the partial
+ * results gathered in rank order form a sorted result.
+ * With a limit, every process stops once enough tuples were found,
+ * by itself or by another process (see EarlyTermination).
  *
  * @param rel1 first relation
  * @param rel2 second relation
  * @param vars1 tuple of variables for first relation
  * @param vars2 tuple of variables for second relation
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are returned (0: all of them)
+ * @param predicates predicates of the query (see join)
+ * @param gather whether the result is gathered on the root, or left
+ * 	  in parts (see collect_result)
  * @return result of join operation
  */
-Relation<int> distributed_join(Relation<int> &rel1,
+static Relation<int> partitioned_join(Relation<int> &rel1,
 		      Relation<int> &rel2,
 		      std::vector<int> &vars1,
-		      std::vector<int> &vars2, HashMethod hash_method)
+		      std::vector<int> &vars2, HashMethod hash_method, std::size_t limit,
+		      const std::vector<Predicate>& predicates, bool gather)
 {
-	mpi::communicator world;
+	Communicator& world = current_communicator();
 
 	std::vector<Relation<int>> div1; 
 	std::vector<Relation<int>> div2;
+	Relation<int> subrel1;
+	Relation<int> subrel2;
+	int replicated = 0; // which relation is replicated (0: none)
+	int dynamic = 0; // whether virtual partitions are handed out on demand
 	if (world.rank() == constants::ROOT) {
-		auto common_vars = common_elems(vars1, vars2);
-		int coord1,coord2;
-		if (common_vars.size() > 0) {
-			coord1=coord2 = 0;
-			for (std::size_t i = 0; i < vars1.size(); i++)
-				if (vars1[i] == common_vars[0])
-					coord1 = i;
-			for (std::size_t i = 0; i < vars2.size(); i++)
-				if (vars2[i] == common_vars[0])
-					coord2 = i;
-		}
-		else // no common variables
-		{
-			coord1=coord2=constants::NONE;
+		if (replicate_small(rel1.size(), rel2.size(), world.size())) {
+			replicated = 1;
+			subrel1 = std::move(rel1);
+			div2 = divide_evenly(rel2, world.size());
+		} else if (replicate_small(rel2.size(), rel1.size(), world.size())) {
+			replicated = 2;
+			subrel2 = std::move(rel2);
+			div1 = divide_evenly(rel1, world.size());
+		} else {
+			// partition on every common variable (none: everything goes to the root)
+			auto common_vars = common_elems(vars1, vars2);
+			int nparts = world.size();
+			if (settings::overpartition > 1 && world.size() > 1 && !common_vars.empty()) {
+				dynamic = 1;
+				nparts *= settings::overpartition;
+			}
+			auto coords1 = key_coords(vars1, common_vars), coords2 = key_coords(vars2, common_vars);
+			if (settings::range_partition) {
+				int stride = sample_stride(rel1.size() + rel2.size(), nparts);
+				auto samples = sample_keys(rel1, coords1, stride);
+				auto samples2 = sample_keys(rel2, coords2, stride);
+				samples.concatenate(samples2);
+				auto splitters = choose_splitters(samples, nparts);
+				// the keys equal to splitters are spread on the larger relation, copied on the other one
+				bool spread1 = rel1.size() >= rel2.size();
+				div1 = divide_by_range(rel1, coords1, splitters, nparts, !spread1);
+				div2 = divide_by_range(rel2, coords2, splitters, nparts, spread1);
+			} else {
+				div1 = divide_tuples(rel1, coords1, hash_method, nparts, settings::hash_seed);
+				div2 = divide_tuples(rel2, coords2, hash_method, nparts, settings::hash_seed);
+			}
 		}
 
-		div1 = divide_tuples(rel1, coord1, hash_method);
-		div2 = divide_tuples(rel2, coord2, hash_method);
-
 		rel1.clear();
 		rel2.clear();
 	}
+	world.broadcast(replicated, constants::ROOT);
+	world.broadcast(dynamic, constants::ROOT);
 
-	Relation<int> subrel1;
-	Relation<int> subrel2;
-	
-	mpi::scatter(world, div1, subrel1, constants::ROOT);
-	mpi::scatter(world, div2, subrel2, constants::ROOT);
+	Relation<int> partial_result;
+	EarlyTermination termination(world, limit);
+	if (dynamic) {
+		partial_result = join_partitions_dynamically(world, div1, div2, vars1, vars2, termination, predicates);
+	} else {
+		if (replicated == 1)
+			broadcast_relation(world, subrel1, constants::ROOT);
+		else
+			scatter_relations(world, div1, subrel1, constants::ROOT);
+		if (replicated == 2)
+			broadcast_relation(world, subrel2, constants::ROOT);
+		else
+			scatter_relations(world, div2, subrel2, constants::ROOT);
 
-	auto partial_result = join(subrel1,
-				   subrel2,
-				   vars1,
-				   vars2);
+		partial_result = join(subrel1,
+				      subrel2,
+				      vars1,
+				      vars2, limit, termination.poll(), predicates);
+		termination.produced(partial_result.size());
+	}
+	termination.finish();
 
-	Relation<int> result;
-	reduce(world, partial_result, result, concatenate_functor<int>(), constants::ROOT);
+	return collect_result(world, partial_result, gather, limit);
+}
 
-	return result;
+Relation<int> distributed_join(Relation<int> &rel1,
+		      Relation<int> &rel2,
+		      std::vector<int> &vars1,
+		      std::vector<int> &vars2, HashMethod hash_method, std::size_t limit,
+		      const std::vector<Predicate>& predicates)
+{
+	return partitioned_join(rel1, rel2, vars1, vars2, hash_method, limit, predicates, settings::gather_result);
 }
 
 
@@ -151,36 +864,74 @@ Relation<int> distributed_join(Relation<int> &rel1,
  * @param varsv vector of corresponding variables
  * @param result_vars vector to identify variables in the resulting relation
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are computed (0: all of them)
+ * @param predicates selection predicates, evaluated when a relation is
+ * 	  read if it binds their variables, or else by the first join that does
+ * @param group_by aggregation of the result (see aggregate_result)
+ * @param output_vars variables of the result (empty: all of them)
  * @return result of join operation as a new relation
  */
 Relation<int> distributed_multiway_join_simple(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars, HashMethod hash_method)
+		   std::vector<int>& result_vars, HashMethod hash_method, std::size_t limit,
+		   const std::vector<Predicate>& predicates, const GroupBy& group_by,
+		   const std::vector<int>& output_vars)
 {
-	mpi::communicator world;
+	Communicator& world = current_communicator();
+	// with an aggregation, the limit is on the groups rather than on the tuples they aggregate,
+	// and without duplicates, on the distinct tuples
+	std::size_t join_limit = (group_by.empty() && !settings::distinct_result) ? limit : 0;
 	auto rel_it = rel_namesv.begin();
 	auto vars_it = varsv.begin();
-	auto arity = read_arity(rel_namesv.front());
-	Relation<int> result_rel(arity);
+	Relation<int> result_rel(read_arity(*rel_it)); // held by the root
 	Relation<int> aux_rel;
-	read_relation(*rel_it, result_rel);
 	result_vars = *vars_it;
+	// the columns no later join needs are dropped (every process computes the same variables)
+	std::vector<int> kept_vars = live_vars(result_vars, remaining_vars(varsv, 1), output_vars,
+					       predicates, group_by);
+	if (world.rank() == constants::ROOT) {
+		load_relation(*rel_it, result_rel);
+		select_tuples(result_rel, result_vars, predicates);
+	}
+	project(result_rel, result_vars, kept_vars);
+	result_vars = kept_vars;
 
 	rel_it++;
 	vars_it++;
-	int round = 0;
 	while (rel_it != rel_namesv.end()) {
+		std::vector<int> later_vars = remaining_vars(varsv, vars_it - varsv.begin() + 1);
+		std::vector<int> aux_vars = live_vars(*vars_it, get_unique_vars(result_vars, later_vars),
+						      output_vars, predicates, group_by);
 		if (world.rank() == constants::ROOT) {
-			aux_rel.clear();
-			aux_rel.set_arity(read_arity(*rel_it));
-			read_relation(*rel_it, aux_rel);
+			load_relation(*rel_it, aux_rel);
+			select_tuples(aux_rel, *vars_it, predicates);
+			project(aux_rel, *vars_it, aux_vars);
 		}
-		result_rel = distributed_join(result_rel, aux_rel, result_vars, *vars_it);
-		result_vars = get_unique_vars(result_vars, *vars_it);
+		// the partial results go back to the root for the next join, the last one is aggregated
+		// or deduplicated where it is
+		bool last = (rel_it + 1 == rel_namesv.end());
+		result_rel = partitioned_join(result_rel, aux_rel, result_vars, aux_vars, hash_method,
+					      last ? join_limit : 0, predicates,
+					      !last || (settings::gather_result && group_by.empty() &&
+							!settings::distinct_result));
+		result_vars = get_unique_vars(result_vars, aux_vars);
+		kept_vars = live_vars(result_vars, later_vars, output_vars, predicates, group_by);
+		project(result_rel, result_vars, kept_vars);
+		result_vars = kept_vars;
 
 		rel_it++;
 		vars_it++;
 	}
+	if (!group_by.empty())
+		return aggregate_result(world, result_rel, result_vars, group_by, hash_method, limit);
+	if (!output_vars.empty()) {
+		project(result_rel, result_vars, output_vars);
+		result_vars = output_vars;
+	}
+	if (settings::distinct_result)
+		return distinct_result(world, result_rel, hash_method, limit);
+	if (limit > 0) // a query of a single relation has no join
+		result_rel.truncate(limit);
 
 	return result_rel;
 }
@@ -188,86 +939,197 @@ Relation<int> distributed_multiway_join_simple(std::vector<std::string>& rel_nam
 /*
  * Auxiliary method for distributed_multiway_join. Performs multijoin
  * in an optimized way (processes scatter their partial results directly
- * to the appropriate machines for the next join).
+ * to the appropriate machines for the next join). A relation small
+ * enough compared to the partial result is replicated on every process
+ * (see settings::broadcast_threshold), and the partial result then
+ * stays where it is. Each new partitioning of the partial result uses
+ * a new seed of the hash function, chosen by the root, so that
+ * consecutive rounds are not correlated. With settings::range_partition,
+ * the partitionings are ranges of keys instead, whose splitters are
+ * sampled from both sides.
+ * With a limit, the processes stop the last join once enough tuples
+ * were found (see EarlyTermination).
  *
  * @param rel_namesv vector containing relations' filenames
  * @param varsv vector of corresponding variables
  * @param result_vars vector to identify variables in the resulting relation
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are computed (0: all of them)
+ * @param predicates selection predicates, evaluated when a relation is
+ * 	  read if it binds their variables, or else by the first join that does
+ * @param group_by aggregation of the result (see aggregate_result)
+ * @param output_vars variables of the result (empty: all of them)
  * @return result of join operation as a new relation
  */
 Relation<int> distributed_multiway_join_forwarding(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars, HashMethod hash_method)
+		   std::vector<int>& result_vars, HashMethod hash_method, std::size_t limit,
+		   const std::vector<Predicate>& predicates, const GroupBy& group_by,
+		   const std::vector<int>& output_vars)
 {
-	mpi::communicator world;
+	Communicator& world = current_communicator();
+	// an aggregation limits the groups, and a duplicate elimination the distinct tuples
+	std::size_t join_limit = (group_by.empty() && !settings::distinct_result) ? limit : 0;
 	auto rel_it = rel_namesv.begin();
 	auto vars_it = varsv.begin();
 	Relation<int> buff_rel; // stores the read relation
 	Relation<int> left_subrel(read_arity(rel_namesv.front())); // stores the remainings of the previous join 
 	std::vector<int> left_vars=*vars_it; // cumulates the unique variables as we go on		
 	if(world.rank()==constants::ROOT){ // the root process starts with the entire first relation, which will be distributed in Part 2 
-		read_relation(*rel_it, left_subrel);
+		load_relation(*rel_it, left_subrel);
+		select_tuples(left_subrel, left_vars, predicates);
 	} 	
+	// the columns no later join needs are dropped before they are shuffled
+	std::vector<int> kept_vars = live_vars(left_vars, remaining_vars(varsv, 1), output_vars, predicates, group_by);
+	project(left_subrel, left_vars, kept_vars);
+	left_vars = kept_vars;
 	rel_it++; // start from second relation
 	vars_it++;	
 	// for each relation, calculate distributed binary join with optimization
-	for(int curr_division_var = constants::NONE, prev_division_var = constants::NONE; rel_it != rel_namesv.end();){ 
-		///////// Pt1: scatter the read relation to right_subrel
+	// division variables are the key of the current partitioning (empty: everything at root,
+	// or spread evenly without key if left_spread is set)
+	bool left_spread = false;
+	std::vector<int> curr_division_vars, prev_division_vars;
+	int division_seed = settings::hash_seed; // seed of the hash function of the current partitioning
+	std::vector<int> division_splitters; // splitters of the current partitioning, with settings::range_partition
+	// divides a relation the way the current partitioning does; the keys equal to splitters
+	// of a range partitioning are spread on the partial result and copied on the read relation
+	auto divide = [&](Relation<int>& rel, const std::vector<int>& coords, bool copy_heavy) {
+		if (settings::range_partition)
+			return divide_by_range(rel, coords, division_splitters, world.size(), copy_heavy);
+		return divide_tuples(rel, coords, hash_method, world.size(), division_seed);
+	};
+	for(int round = 0; rel_it != rel_namesv.end(); round++){ 
+		///////// Pt1: scatter (or replicate, if it is small) the read relation to right_subrel
 		std::vector<Relation<int> > divided_buff_rel; std::vector<int> & right_vars = *vars_it;
+		std::vector<int> later_vars = remaining_vars(varsv, vars_it - varsv.begin() + 1);
+		// columns of the read relation that are sent (right_vars still describes buff_rel)
+		std::vector<int> right_kept = live_vars(right_vars, get_unique_vars(left_vars, later_vars),
+							output_vars, predicates, group_by);
+		Relation<int> right_subrel;
+		std::vector<std::size_t> left_size{left_subrel.size()};
+		if (settings::broadcast_threshold > 0 || settings::range_partition)
+			world.reduce(left_size, ReduceOp::Sum, constants::ROOT);
+		int replicated = 0;
+		int new_division = 0; // whether left_subrel is divided again (on curr_division_vars)
+		int stride = 1; // one tuple in stride is sampled for the splitters
 		if (world.rank() == constants::ROOT) { 
-			buff_rel.clear();
-			buff_rel.set_arity(read_arity(*rel_it));
-			read_relation(*rel_it, buff_rel);		
+			load_relation(*rel_it, buff_rel);
+			select_tuples(buff_rel, right_vars, predicates);
 			auto common_vars = common_elems(left_vars, right_vars); //calculate common variables
-			// decide reference variable for division
-			if(find(common_vars.begin(), common_vars.end(), prev_division_var)!=common_vars.end()) // if our division is still valid, keep it
-				curr_division_var = prev_division_var;
-			else // otherwise we need to find new reference variable
-			{
-				if(common_vars.size()>0)
-					curr_division_var = common_vars[0];
-				
-				else // there may be none
-					curr_division_var = constants::NONE;				
+			// decide reference key for division
+			if(replicate_small(buff_rel.size(), left_size.front(), world.size())) { // left_subrel stays where it is
+				replicated = 1;
+				curr_division_vars = prev_division_vars;
+				right_subrel = std::move(buff_rel);
+			}
+			else {
+				if(partitioning_valid(prev_division_vars, common_vars)) // if our division is still valid, keep it
+					curr_division_vars = prev_division_vars;
+				else // otherwise partition on all the common variables (there may be none)
+					curr_division_vars = common_vars;
+				new_division = (curr_division_vars != prev_division_vars || left_spread);
+				if (new_division)
+					division_seed = derive_seed(settings::hash_seed, round);
+				stride = sample_stride(left_size.front() + buff_rel.size(), world.size());
 			}
-			int division_index = (curr_division_var==constants::NONE)? 
-				constants::NONE : std::find(right_vars.begin(),right_vars.end(),curr_division_var)-right_vars.begin();
-			divided_buff_rel = divide_tuples(buff_rel, division_index, hash_method);
 		}		
-		mpi::broadcast(world, curr_division_var, constants::ROOT);
-		Relation<int> right_subrel;
-		mpi::scatter(world, divided_buff_rel, right_subrel, constants::ROOT);
+		world.broadcast(replicated, constants::ROOT);
+		world.broadcast(new_division, constants::ROOT);
+		world.broadcast(curr_division_vars, constants::ROOT);
+		world.broadcast(division_seed, constants::ROOT);
+		if (new_division && settings::range_partition) {
+			// splitters of the keys of both sides: left_subrel is sampled where it is
+			world.broadcast(stride, constants::ROOT);
+			auto left_coords = key_coords(left_vars, curr_division_vars);
+			Relation<int> samples = sample_keys(left_subrel, left_coords, stride), all_samples;
+			std::vector<Relation<int>> gathered;
+			world.gather(samples, gathered, constants::ROOT);
+			if (world.rank() == constants::ROOT) {
+				all_samples = merge_sorted(gathered);
+				auto right_samples = sample_keys(buff_rel, key_coords(right_vars, curr_division_vars), stride);
+				all_samples.concatenate(right_samples);
+				division_splitters = choose_splitters(all_samples, world.size());
+			}
+			world.broadcast(division_splitters, constants::ROOT);
+		}
+		if (world.rank() == constants::ROOT && !replicated) {
+			auto coords = key_coords(right_vars, curr_division_vars);
+			// self-joins divide the same file on the same key again; the splitters of
+			// a range partitioning are sampled from the data, so it is hardly reused
+			if (settings::cache_relations && !settings::range_partition) {
+				std::vector<int> key{0, (int) hash_method, division_seed, world.size()};
+				auto selection = selection_key(right_vars, predicates);
+				key.insert(key.end(), selection.begin(), selection.end());
+				key.insert(key.end(), coords.begin(), coords.end());
+				divided_buff_rel = relation_catalog().partitioned(*rel_it, key,
+					selecting(right_vars, predicates, [&](Relation<int>& rel) { return divide(rel, coords, true); }));
+			}
+			else
+				divided_buff_rel = divide(buff_rel, coords, true);
+			buff_rel = Relation<int>(); // the parts hold its tuples
+			for (auto& part : divided_buff_rel)
+				project(part, right_vars, right_kept);
+		}
+		if (world.rank() == constants::ROOT && replicated)
+			project(right_subrel, right_vars, right_kept);
+		if (replicated)
+			broadcast_relation(world, right_subrel, constants::ROOT);
+		else
+			scatter_relations(world, divided_buff_rel, right_subrel, constants::ROOT);
 
 		///////// Pt2: scatter the remainings (left_subrel) to the appropriate machines
-		if(curr_division_var != prev_division_var) // we only have to scatter if previous division is now invalid
+		if(replicated) // any division is fine, as long as the root does not hold everything
+		{
+			if(curr_division_vars.empty() && !left_spread)
+			{
+				std::vector<Relation<int>> divided_prev_left_rel;
+				if (world.rank() == constants::ROOT)
+					divided_prev_left_rel = divide_evenly(left_subrel, world.size());
+				scatter_relations(world, divided_prev_left_rel, left_subrel, constants::ROOT);
+				left_spread = true;
+			}
+		}
+		else if(new_division) // we only have to scatter if previous division is now invalid
 		{
 			Relation<int> prev_left_subrel = left_subrel; //backup data, so we can distribute it
 			std::vector<Relation<int>> divided_prev_left_rel;
-			int division_index = (curr_division_var==constants::NONE)?
-				constants::NONE : std::find(left_vars.begin(),left_vars.end(),curr_division_var)-left_vars.begin();
-			divided_prev_left_rel=divide_tuples(prev_left_subrel, division_index,  hash_method);			
+			divided_prev_left_rel = divide(prev_left_subrel, key_coords(left_vars, curr_division_vars), false);
 			for(int i=0; i<world.size(); i++){
-				mpi::reduce(world, divided_prev_left_rel[i], left_subrel, concatenate_functor<int>(), i);
+				gather_relations(world, divided_prev_left_rel[i], left_subrel, i, Phase::Shuffle);
 			}			
+			left_spread = false;
 		}		
 		////////  Pt 3 Calculate the binary join of left_subrel and right_subrel
+		bool last = (rel_it + 1 == rel_namesv.end());
+		EarlyTermination termination(world, last ? join_limit : 0);
 		left_subrel = join(left_subrel,
 					   right_subrel,
 					   left_vars,
-					   right_vars);	
+					   right_kept, last ? join_limit : 0, termination.poll(), predicates);	
+		termination.produced(left_subrel.size());
+		termination.finish();
 		// loop update
 		rel_it++;
 		vars_it++;
-		left_vars = get_unique_vars(left_vars, right_vars);
-		prev_division_var=curr_division_var;
+		left_vars = get_unique_vars(left_vars, right_kept);
+		kept_vars = live_vars(left_vars, later_vars, output_vars, predicates, group_by);
+		project(left_subrel, left_vars, kept_vars);
+		left_vars = kept_vars;
+		prev_division_vars=curr_division_vars;
 	}
 
-	Relation<int> result_rel;
-	reduce(world, left_subrel, result_rel, concatenate_functor<int>(), constants::ROOT);
 	result_vars = std::vector<int>(left_vars);
+	if (!group_by.empty())
+		return aggregate_result(world, left_subrel, result_vars, group_by, hash_method, limit);
+	if (!output_vars.empty()) {
+		project(left_subrel, result_vars, output_vars);
+		result_vars = output_vars;
+	}
+	if (settings::distinct_result)
+		return distinct_result(world, left_subrel, hash_method, limit);
 
-	return result_rel;
+	return collect_result(world, left_subrel, settings::gather_result, limit);
 }
 
 /*
@@ -280,15 +1142,24 @@ Relation<int> distributed_multiway_join_forwarding(std::vector<std::string>& rel
  * @param result_vars vector to identify variables in the resulting relation
  * @param forward flag to enable auto-forward optimization
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are computed (0: all of them)
+ * @param predicates selection predicates (see predicate.h)
+ * @param group_by aggregation of the result (see aggregate.h)
+ * @param output_vars variables of the result (see live_vars)
  * @return result of join operation as a new relation
  */
 Relation<int> distributed_multiway_join(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars, bool forward, HashMethod hash_method)
+		   std::vector<int>& result_vars, bool forward, HashMethod hash_method, std::size_t limit,
+		   const std::vector<Predicate>& predicates, const GroupBy& group_by,
+		   const std::vector<int>& output_vars)
 {
+	CatalogScope scope;
 	if(forward)
-		return  distributed_multiway_join_forwarding(rel_namesv, varsv, result_vars, hash_method);
-	return distributed_multiway_join_simple(rel_namesv, varsv, result_vars, hash_method);
+		return  distributed_multiway_join_forwarding(rel_namesv, varsv, result_vars, hash_method, limit,
+							     predicates, group_by, output_vars);
+	return distributed_multiway_join_simple(rel_namesv, varsv, result_vars, hash_method, limit, predicates,
+						group_by, output_vars);
 }
 
 /*
@@ -343,36 +1214,22 @@ std::vector<int> equally_factorize(int num_procs, int num_vars){
  * @param vars vector indicating the corresponding vars of the tuple
  * @param address_limits vector with the limits of each coordinate in the vector form of a process' address
  * @param destinations reference to vector where we will store the result
- * @param hash_method hash function used by the algorithm
+ * @param hashes hash function of each dimension (variable)
  */
+template<typename Hash>
 void calculate_destinations(Relation<int>::tuple_t& tuple, std::vector<int>& vars, std::vector<int>& address_limits, 
-	 std::vector<int>& destinations, HashMethod hash_method){	
+	 std::vector<int>& destinations, const std::vector<Hash>& hashes){	
 	// given a vector (x1, ..., xk) where 0<=xi<mi, we can map it uniquely to  {0, ... , m1*...*mk-1}
 	// by doing h(x1, ... , xk) = x1+m1*x2+m1*m2*x3+..., which can be calculated recursively
 	// through s_k = s_(k-1)*m_k+x_k
 
 	std::function<void(int, int)> recursive_calc = 
-	[&tuple,&vars,&address_limits,&destinations, &recursive_calc, hash_method](int var_index, int curr_sum){
+	[&tuple,&vars,&address_limits,&destinations, &recursive_calc, &hashes](int var_index, int curr_sum){
 		if(var_index==-1) // if I've already chosen every entry in the address, curr_sum stores the process rank
 			destinations.push_back(curr_sum);
 		else if(find(vars.begin(), vars.end(), var_index)!=vars.end()){ // if this is one the variables, use hash to decide x_k
 			int coord = find(vars.begin(), vars.end(), var_index)-vars.begin();
-			int r;
-			switch(hash_method)
-			{
-				case HashMethod::ModHash:
-			 		r=mod_hash(tuple[coord], address_limits[var_index]);
-			 		break;
-			 	case HashMethod::MultHash:
-			 		r=mult_hash(tuple[coord], address_limits[var_index]);
-			 		break;
-			 	case HashMethod::MurmurHash:
-			 		r=murmur_hash(tuple[coord], address_limits[var_index]);
-			 		break;
-			 	default:
-			 		throw("Invalid hash method");
-			 		break;
-			}
+			int r = hashes[var_index](tuple[coord], address_limits[var_index]);
 			recursive_calc(var_index-1, r+address_limits[var_index]*curr_sum);
 		}
 		else
@@ -392,20 +1249,87 @@ void calculate_destinations(Relation<int>::tuple_t& tuple, std::vector<int>& var
  * @param divided_rel reference to vector of relations where we will store the result,i.e., the splitted relations
  * @param vars vector indicating the corresponding vars of the tuple
  * @param address_limits vector with the limits of each coordinate in the vector form of a process' address
- * @param hash_method hash function used by the algorithm
+ * @param seed seed of the hash functions; each dimension derives its own from it
  */
+template<typename Hash>
 void hypercube_divide_tuples(Relation<int>& rel, std::vector<Relation<int>>& divided_rel,
-	std::vector<int>& vars, std::vector<int>& address_limits, HashMethod hash_method)
+	std::vector<int>& vars, std::vector<int>& address_limits, std::uint32_t seed)
 		
 {	
-		for(auto tuple : rel)
+		// independent hash functions, so that the coordinates of the dimensions are not correlated
+		std::vector<Hash> hashes;
+		for (std::size_t dim = 0; dim < address_limits.size(); dim++)
+			hashes.emplace_back(derive_seed(seed, dim));
+
+		std::vector<int> destinations;
+		for(auto& tuple : rel)
 		{
-			std::vector<int> destinations;
-			calculate_destinations(tuple,vars,address_limits,destinations, hash_method);
+			destinations.clear();
+			calculate_destinations(tuple,vars,address_limits,destinations, hashes);
 			for(int dest:destinations){
 				divided_rel[dest].push_tuple(tuple);
 			}
 		}
+		for (auto& part : divided_rel)
+			part.set_order(rel.get_order());
+}
+
+/* selects the hash family once for the whole relation */
+void hypercube_divide_tuples(Relation<int>& rel, std::vector<Relation<int>>& divided_rel,
+	std::vector<int>& vars, std::vector<int>& address_limits, HashMethod hash_method, std::uint32_t seed)
+{
+	PhaseScope phase(Phase::Partition);
+	switch(hash_method)
+	{
+		case HashMethod::ModHash:
+	 		hypercube_divide_tuples<ModHash>(rel, divided_rel, vars, address_limits, seed);
+	 		break;
+	 	case HashMethod::MultHash:
+	 		hypercube_divide_tuples<MultHash>(rel, divided_rel, vars, address_limits, seed);
+	 		break;
+	 	case HashMethod::MurmurHash:
+	 		hypercube_divide_tuples<MurmurHash>(rel, divided_rel, vars, address_limits, seed);
+	 		break;
+	 	case HashMethod::TabulationHash:
+	 		hypercube_divide_tuples<TabulationHash>(rel, divided_rel, vars, address_limits, seed);
+	 		break;
+	 	default:
+	 		throw("Invalid hash method");
+	}
+}
+
+/*
+ * Reads a relation file, selects the tuples satisfying the predicates
+ * it binds, and splits them according to the hypercube algorithm,
+ * through the relation catalog (see catalog.h)
+ *
+ * @param filename name of the relation file
+ * @param vars vector indicating the corresponding vars of the tuple
+ * @param address_limits vector with the limits of each coordinate in the vector form of a process' address
+ * @param hash_method hash function used by the algorithm
+ * @param predicates predicates of the query
+ * @return the splitted relations, one per process
+ */
+static std::vector<Relation<int>> load_hypercube_partitioned(const std::string& filename,
+	std::vector<int>& vars, std::vector<int>& address_limits, HashMethod hash_method,
+	const std::vector<Predicate>& predicates)
+{
+	// the selection, the vars and the limits, separated by -1, identify the division
+	std::vector<int> key{1, (int) hash_method, (int) settings::hash_seed};
+	auto selection = selection_key(vars, predicates);
+	key.insert(key.end(), selection.begin(), selection.end());
+	key.insert(key.end(), vars.begin(), vars.end());
+	key.push_back(-1);
+	key.insert(key.end(), address_limits.begin(), address_limits.end());
+
+	return load_partitioned(filename, key, selecting(vars, predicates, [&](Relation<int>& rel) {
+		int num_procs = 1; // product of the limits
+		for (int limit : address_limits)
+			num_procs *= limit;
+		std::vector<Relation<int>> divided_rel(num_procs, Relation<int>(rel.get_arity()));
+		hypercube_divide_tuples(rel, divided_rel, vars, address_limits, hash_method, settings::hash_seed);
+		return divided_rel;
+	}));
 }
 
 /*
@@ -418,13 +1342,25 @@ void hypercube_divide_tuples(Relation<int>& rel, std::vector<Relation<int>>& div
  * @param result_vars vector to identify variables in the resulting relation
  * @param forward flag to enable auto-forward optimization
  * @param hash_method hash function used by the algorithm
+ * @param limit at most limit tuples are computed (0: all of them); the
+ * 	  processes stop the last local join once enough tuples were
+ * 	  found (see EarlyTermination)
+ * @param predicates selection predicates, evaluated when a relation is
+ * 	  read if it binds their variables, or else by the first join that does
+ * @param group_by aggregation of the result (see aggregate_result)
+ * @param output_vars variables of the result (empty: all of them)
  * @return result of join operation as a new relation
  */
 Relation<int> hypercube_distributed_multiway_join(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars, HashMethod hash_method)
+		   std::vector<int>& result_vars, HashMethod hash_method, std::size_t limit,
+		   const std::vector<Predicate>& predicates, const GroupBy& group_by,
+		   const std::vector<int>& output_vars)
 {
-	mpi::communicator world;
+	CatalogScope scope;
+	Communicator& world = current_communicator();
+	// an aggregation limits the groups, and a duplicate elimination the distinct tuples
+	std::size_t join_limit = (group_by.empty() && !settings::distinct_result) ? limit : 0;
 	int num_procs = world.size();
 	std::vector<int> address_limits;
 	if(world.rank()==constants::ROOT){
@@ -437,36 +1373,57 @@ Relation<int> hypercube_distributed_multiway_join(std::vector<std::string>& rel_
 	//divide first relation to initialize local_result_rel
 	Relation<int> local_result_rel; std::vector<int> local_vars=varsv.front();
 	std::vector<Relation<int>> divided_buff_rel;
+	// the columns no later join needs are dropped by the root before it scatters the parts
+	std::vector<int> kept_vars = live_vars(local_vars, remaining_vars(varsv, 1), output_vars, predicates, group_by);
 	if (world.rank() == constants::ROOT) {
-			Relation<int> buff_rel;			
-			buff_rel.set_arity(read_arity(rel_namesv.front()));
-			read_relation(rel_namesv.front(), buff_rel); 
-			divided_buff_rel.assign(num_procs, Relation<int>(buff_rel.get_arity()));
-			hypercube_divide_tuples(buff_rel, divided_buff_rel, varsv.front(), address_limits, hash_method);
+		divided_buff_rel = load_hypercube_partitioned(rel_namesv.front(), varsv.front(), address_limits,
+							      hash_method, predicates);
+		for (auto& part : divided_buff_rel)
+			project(part, local_vars, kept_vars);
 	}
+	local_vars = kept_vars;
 	// scatter from divided_buff_rel to local_result_rel
-	mpi::scatter(world, divided_buff_rel, local_result_rel, constants::ROOT);
+	scatter_relations(world, divided_buff_rel, local_result_rel, constants::ROOT);
 
 	auto rel_it = ++rel_namesv.begin(); auto vars_it = ++varsv.begin();
 	for(;rel_it!=rel_namesv.end();rel_it++,vars_it++) {		
 		Relation<int> local_buff_rel;
+		std::vector<int> later_vars = remaining_vars(varsv, vars_it - varsv.begin() + 1);
+		std::vector<int> buff_vars = live_vars(*vars_it, get_unique_vars(local_vars, later_vars),
+						       output_vars, predicates, group_by);
 		if (world.rank() == constants::ROOT) {
-			Relation<int> buff_rel;			
-			buff_rel.set_arity(read_arity(*rel_it));
-			read_relation(*rel_it, buff_rel);
-			divided_buff_rel.assign(num_procs, Relation<int>(buff_rel.get_arity()));
-			hypercube_divide_tuples(buff_rel, divided_buff_rel, *vars_it, address_limits, hash_method);
-		}	
+			divided_buff_rel = load_hypercube_partitioned(*rel_it, *vars_it, address_limits,
+								      hash_method, predicates);
+			for (auto& part : divided_buff_rel)
+				project(part, *vars_it, buff_vars);
+		}
 		//scatter from divided_buff_rel to local_buff_rel
-		mpi::scatter(world, divided_buff_rel, local_buff_rel, constants::ROOT);
+		scatter_relations(world, divided_buff_rel, local_buff_rel, constants::ROOT);
 		//join local_result_rel to the relation that was read and divided
-		local_result_rel = join(local_result_rel, local_buff_rel, local_vars, *vars_it);	
-		local_vars = get_unique_vars(local_vars, *vars_it);
+		bool last = (rel_it + 1 == rel_namesv.end());
+		EarlyTermination termination(world, last ? join_limit : 0);
+		local_result_rel = join(local_result_rel, local_buff_rel, local_vars, buff_vars,
+					last ? join_limit : 0, termination.poll(), predicates);	
+		termination.produced(local_result_rel.size());
+		termination.finish();
+		local_vars = get_unique_vars(local_vars, buff_vars);
+		kept_vars = live_vars(local_vars, later_vars, output_vars, predicates, group_by);
+		project(local_result_rel, local_vars, kept_vars);
+		local_vars = kept_vars;
 	}
+	if (!group_by.empty()) {
+		auto groups = aggregate_result(world, local_result_rel, local_vars, group_by, hash_method, limit);
+		result_vars = local_vars;
+		return groups;
+	}
+	if (!output_vars.empty()) {
+		project(local_result_rel, local_vars, output_vars);
+		local_vars = output_vars;
+	}
+	result_vars = local_vars;
+	if (settings::distinct_result)
+		return distinct_result(world, local_result_rel, hash_method, limit);
 	// combine all local results
-	Relation<int> result_rel;	
-	mpi::reduce(world, local_result_rel, result_rel, concatenate_functor<int>(), constants::ROOT);
-
-	return result_rel;
+	return collect_result(world, local_result_rel, settings::gather_result, limit);
 	
 }
@@ -0,0 +1,132 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "predicate.h"
+
+/*
+ * Parses an integer token, the whole of it
+ */
+static int parse_int(const std::string& token)
+{
+	std::size_t end = 0;
+	int x = 0;
+	try {
+		x = std::stoi(token, &end);
+	} catch (std::exception&) {
+		end = 0;
+	}
+	if (end == 0 || end != token.size())
+		throw std::invalid_argument("invalid predicate operand: " + token);
+
+	return x;
+}
+
+Predicate parse_predicate(const std::string& lhs, const std::string& op, const std::string& rhs)
+{
+	Predicate predicate;
+	predicate.var = parse_int(lhs);
+	if (op == "=" || op == "==")	predicate.op = CompareOp::Eq;
+	else if (op == "!=")		predicate.op = CompareOp::Ne;
+	else if (op == "<")		predicate.op = CompareOp::Lt;
+	else if (op == "<=")		predicate.op = CompareOp::Le;
+	else if (op == ">")		predicate.op = CompareOp::Gt;
+	else if (op == ">=")		predicate.op = CompareOp::Ge;
+	else
+		throw std::invalid_argument("invalid predicate operator: " + op);
+	predicate.constant = !rhs.empty() && rhs[0] == '#';
+	predicate.rhs = parse_int(predicate.constant ? rhs.substr(1) : rhs);
+
+	return predicate;
+}
+
+/*
+ * Checks whether every variable of a predicate appears in vars
+ */
+static bool is_bound(const Predicate& predicate, const std::vector<int>& vars)
+{
+	auto appears = [&vars](int var) { return std::find(vars.begin(), vars.end(), var) != vars.end(); };
+	return appears(predicate.var) && (predicate.constant || appears(predicate.rhs));
+}
+
+void check_predicates(const std::vector<Predicate>& predicates,
+		      const std::vector<std::vector<int>>& varsv)
+{
+	std::vector<int> query_vars;
+	for (auto& vars : varsv)
+		query_vars.insert(query_vars.end(), vars.begin(), vars.end());
+	for (auto& predicate : predicates) {
+		std::vector<int> vars{predicate.var};
+		if (!predicate.constant)
+			vars.push_back(predicate.rhs);
+		for (int var : vars)
+			if (std::find(query_vars.begin(), query_vars.end(), var) == query_vars.end())
+				throw std::invalid_argument("Predicate on variable " + std::to_string(var) +
+							    ", which is in no relation");
+	}
+}
+
+std::vector<Predicate> bound_predicates(const std::vector<Predicate>& predicates,
+					const std::vector<int>& vars)
+{
+	std::vector<Predicate> bound;
+	for (auto& predicate : predicates)
+		if (is_bound(predicate, vars))
+			bound.push_back(predicate);
+
+	return bound;
+}
+
+std::vector<Predicate> join_predicates(const std::vector<Predicate>& predicates,
+				       const std::vector<int>& vars1,
+				       const std::vector<int>& vars2,
+				       const std::vector<int>& unique_vars)
+{
+	std::vector<Predicate> bound;
+	for (auto& predicate : predicates)
+		if (is_bound(predicate, unique_vars) &&
+		    !is_bound(predicate, vars1) && !is_bound(predicate, vars2))
+			bound.push_back(predicate);
+
+	return bound;
+}
+
+Selection::Selection(const std::vector<Predicate>& predicates, const std::vector<int>& vars)
+{
+	auto coord = [&vars](int var) { return (int) (std::find(vars.begin(), vars.end(), var) - vars.begin()); };
+	for (auto& predicate : predicates)
+		tests.push_back(Test{coord(predicate.var), predicate.op,
+				     predicate.constant ? -1 : coord(predicate.rhs), predicate.rhs});
+}
+
+std::vector<int> Selection::key() const
+{
+	std::vector<int> key;
+	for (auto& test : tests) {
+		key.push_back(test.coord);
+		key.push_back((int) test.op);
+		key.push_back(test.rhs_coord);
+		key.push_back(test.rhs_coord < 0 ? test.value : 0);
+	}
+
+	return key;
+}
+
+void select_tuples(Relation<int>& rel, const std::vector<int>& vars,
+		   const std::vector<Predicate>& predicates)
+{
+	Selection selection(bound_predicates(predicates, vars), vars);
+	if (selection.empty())
+		return;
+
+	Relation<int> selected(rel.get_arity());
+	for (auto& tpl : rel)
+		if (selection(tpl))
+			selected.push_tuple(std::move(tpl));
+	selected.set_order(rel.get_order());
+	rel = std::move(selected);
+}
@@ -0,0 +1,138 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "communicator.h"
+#include "mpiutil.h"
+#include "profile.h"
+
+/* time spent by this thread in every phase, in nanoseconds */
+static thread_local std::uint64_t phase_nanos[NUM_PHASES];
+/* innermost phase of this thread */
+static thread_local PhaseScope* current_scope = nullptr;
+/* local joins of this thread: their number, input tuples and output tuples */
+static thread_local std::size_t join_totals[3];
+
+static std::uint64_t nanos_between(std::chrono::steady_clock::time_point from,
+				   std::chrono::steady_clock::time_point to)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+PhaseScope::PhaseScope(Phase p)
+	: memory(p), phase{p}, outer{current_scope}, start{std::chrono::steady_clock::now()}
+{
+	if (outer)
+		phase_nanos[static_cast<int>(outer->phase)] += nanos_between(outer->start, start);
+	current_scope = this;
+}
+
+PhaseScope::~PhaseScope()
+{
+	auto now = std::chrono::steady_clock::now();
+	phase_nanos[static_cast<int>(phase)] += nanos_between(start, now);
+	current_scope = outer;
+	if (outer)
+		outer->start = now;
+}
+
+void record_join(std::size_t input1, std::size_t input2, std::size_t output)
+{
+	join_totals[0]++;
+	join_totals[1] += input1 + input2;
+	join_totals[2] += output;
+}
+
+/*
+ * Writes "name": {"min": .., "max": .., "avg": .., "per_process": [..]}
+ * for one column of the table of all processes
+ *
+ * @param os stream where the field is written
+ * @param name name of the field
+ * @param table one row per process
+ * @param nprocs number of processes
+ * @param row length of a row
+ * @param col column of the field
+ * @param seconds whether the values are nanoseconds, written as seconds
+ */
+static void write_field(std::ostream& os, const std::string& name, const std::vector<std::size_t>& table,
+			int nprocs, std::size_t row, std::size_t col, bool seconds)
+{
+	auto value = [&](double x) -> std::ostream& {
+		if (seconds)
+			return os << std::fixed << std::setprecision(6) << x * 1e-9;
+		return os << (std::size_t) x;
+	};
+
+	std::size_t min = table[col], max = 0, sum = 0;
+	for (int proc = 0; proc < nprocs; proc++) {
+		std::size_t x = table[proc * row + col];
+		min = std::min(min, x);
+		max = std::max(max, x);
+		sum += x;
+	}
+	os << "\"" << name << "\": {\"min\": ";
+	value(min) << ", \"max\": ";
+	value(max) << ", \"avg\": ";
+	os << std::fixed << std::setprecision(6) << (seconds ? 1e-9 : 1.0) * sum / nprocs << ", \"per_process\": [";
+	for (int proc = 0; proc < nprocs; proc++)
+		value(table[proc * row + col]) << (proc + 1 < nprocs ? ", " : "");
+	os << "]}";
+}
+
+void report_profile(std::ostream& os)
+{
+	Communicator& world = current_communicator();
+	int nprocs = world.size();
+	auto& shuffles = shuffle_log();
+
+	// row of this process: the time of each phase, the joins, then five fields per shuffle
+	const std::size_t row = NUM_PHASES + 3 + 5 * shuffles.size();
+	std::vector<std::size_t> table(nprocs * row, 0);
+	auto it = table.begin() + world.rank() * row;
+	it = std::copy(phase_nanos, phase_nanos + NUM_PHASES, it);
+	it = std::copy(join_totals, join_totals + 3, it);
+	for (auto& stats : shuffles)
+		for (std::size_t field : {stats.tuples, stats.raw_bytes, stats.sent_bytes,
+					  stats.received, stats.received_bytes})
+			*it++ = field;
+	world.reduce(table, ReduceOp::Sum, constants::ROOT);
+
+	if (world.rank() != constants::ROOT)
+		return;
+	auto flags = os.flags();
+	auto precision = os.precision();
+
+	os << "{\"processes\": " << nprocs << ",\n \"phases\": {";
+	for (int phase = 0; phase < NUM_PHASES; phase++) {
+		os << (phase ? ",\n  " : "\n  ");
+		write_field(os, phase_name(static_cast<Phase>(phase)), table, nprocs, row, phase, true);
+	}
+	os << "},\n \"joins\": {\n  ";
+	const char* join_fields[] = {"count", "input_tuples", "output_tuples"};
+	for (int i = 0; i < 3; i++) {
+		os << (i ? ",\n  " : "");
+		write_field(os, join_fields[i], table, nprocs, row, NUM_PHASES + i, false);
+	}
+	os << "},\n \"shuffles\": [";
+	const char* shuffle_fields[] = {"tuples_sent", "bytes_raw", "bytes_sent", "tuples_received", "bytes_received"};
+	for (std::size_t i = 0; i < shuffles.size(); i++) {
+		os << (i ? ",\n  {" : "\n  {");
+		for (int j = 0; j < 5; j++) {
+			os << (j ? ",\n   " : "");
+			write_field(os, shuffle_fields[j], table, nprocs, row, NUM_PHASES + 3 + 5 * i + j, false);
+		}
+		os << "}";
+	}
+	os << "]}" << std::endl;
+
+	os.flags(flags);
+	os.precision(precision);
+}
@@ -0,0 +1,159 @@
+/*
+ * Created in Palaiseau (France) in 30/05/2018 by:
+ * Cauim de S. Lima (cauimsouza@gmail.com)
+ * Victor Hugo V. Silva (vitorvianna10@gmail.com)
+ */
+
+#include <string>
+#include <stdexcept>
+#include "settings.h"
+
+namespace settings {
+	bool compress_shuffles = false;
+	bool report_shuffles = false;
+	double broadcast_threshold = 1.0;
+	int threads = 0;
+	int overpartition = 1;
+	bool range_partition = false;
+	unsigned hash_seed = 0;
+	std::size_t memory_budget = 0;
+	std::string scratch_dir = "/tmp";
+	bool cache_relations = true;
+	bool report_memory = false;
+	std::size_t result_limit = 0;
+	bool report_profile = false;
+	std::string profile_file;
+	bool gather_result = true;
+	bool check_fingerprint = false;
+	std::string fingerprint_file;
+	bool distinct_result = false;
+	bool distinct_inputs = false;
+	bool packed_keys = true;
+	bool csr_index = false;
+}
+
+/*
+ * Parses the value of a boolean flag. A flag given without value
+ * ("--name") is read as true.
+ */
+static bool parse_bool(const std::string& name, const std::string& value)
+{
+	if (value.empty() || value == "1" || value == "true" || value == "on")
+		return true;
+	if (value == "0" || value == "false" || value == "off")
+		return false;
+	throw std::invalid_argument("invalid value for --" + name + ": " + value);
+}
+
+/*
+ * Parses the value of a non-negative numeric flag
+ */
+static double parse_number(const std::string& name, const std::string& value)
+{
+	std::size_t end = 0;
+	double x = -1;
+	try {
+		x = std::stod(value, &end);
+	} catch (std::exception&) {
+		end = 0;
+	}
+	if (end == 0 || end != value.size() || x < 0)
+		throw std::invalid_argument("invalid value for --" + name + ": " + value);
+
+	return x;
+}
+
+/*
+ * Parses a number of bytes, with an optional K, M or G suffix
+ */
+static std::size_t parse_bytes(const std::string& name, const std::string& value)
+{
+	std::size_t unit = 1;
+	std::string digits = value;
+	if (!digits.empty()) {
+		switch (digits.back()) {
+		case 'K': case 'k': unit = 1ul << 10; break;
+		case 'M': case 'm': unit = 1ul << 20; break;
+		case 'G': case 'g': unit = 1ul << 30; break;
+		}
+		if (unit > 1)
+			digits.pop_back();
+	}
+
+	return (std::size_t) (parse_number(name, digits) * unit);
+}
+
+/*
+ * Consumes every "--name[=value]" flag in argv, updating the
+ * corresponding setting, and compacts the remaining positional
+ * arguments to the front of argv.
+ *
+ * @param argc number of arguments, updated to the number of
+ * 	positional arguments left
+ * @param argv arguments
+ * @throw std::invalid_argument if a flag is unknown or malformed
+ */
+void parse_settings(int& argc, char* argv[])
+{
+	int kept = 0;
+	for (int i = 0; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (i == 0 || arg.compare(0, 2, "--") != 0) {
+			argv[kept++] = argv[i];
+			continue;
+		}
+
+		std::string name = arg.substr(2), value;
+		auto eq = name.find('=');
+		if (eq != std::string::npos) {
+			value = name.substr(eq + 1);
+			name = name.substr(0, eq);
+		}
+
+		if (name == "compress")
+			settings::compress_shuffles = parse_bool(name, value);
+		else if (name == "report")
+			settings::report_shuffles = parse_bool(name, value);
+		else if (name == "broadcast")
+			settings::broadcast_threshold = parse_number(name, value);
+		else if (name == "threads")
+			settings::threads = (int) parse_number(name, value);
+		else if (name == "seed")
+			settings::hash_seed = (unsigned) parse_number(name, value);
+		else if (name == "range")
+			settings::range_partition = parse_bool(name, value);
+		else if (name == "overpartition")
+			settings::overpartition = (int) parse_number(name, value);
+		else if (name == "memory")
+			settings::memory_budget = parse_bytes(name, value);
+		else if (name == "scratch")
+			settings::scratch_dir = value;
+		else if (name == "memstats")
+			settings::report_memory = parse_bool(name, value);
+		else if (name == "cache")
+			settings::cache_relations = parse_bool(name, value);
+		else if (name == "profile") {
+			settings::report_profile = true;
+			settings::profile_file = value;
+		}
+		else if (name == "gather")
+			settings::gather_result = parse_bool(name, value);
+		else if (name == "fingerprint") {
+			settings::check_fingerprint = true;
+			settings::fingerprint_file = value;
+		}
+		else if (name == "distinct")
+			settings::distinct_result = parse_bool(name, value);
+		else if (name == "distinct-inputs")
+			settings::distinct_inputs = parse_bool(name, value);
+		else if (name == "index")
+			settings::csr_index = parse_bool(name, value);
+		else if (name == "packed")
+			settings::packed_keys = parse_bool(name, value);
+		else if (name == "limit")
+			settings::result_limit = (std::size_t) parse_number(name, value);
+		else
+			throw std::invalid_argument("unknown option --" + name);
+	}
+	argc = kept;
+}
@@ -5,12 +5,20 @@
  */
 
 #include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <utility>
 #include <set>
+#include <stdexcept>
+#include <string>
 #include "util.h"
+#include "catalog.h"
+#include "csr.h"
 #include "ioutil.h"
 #include "debug.h"
+#include "external.h"
+#include "profile.h"
+#include "settings.h"
 
 /*
  * Takes a vector of integers var_vect and a subvector
@@ -207,78 +215,532 @@ std::vector<int> merge_reduce_tpls(const std::vector<int>& tpl1,
 	return tpl;
 }
 
+/*
+ * Order of the result of a join whose first relation was sorted on
+ * the columns order1: the tuples of the result come out in the order
+ * of the first relation.
+ *
+ * @param order1 columns the first relation is sorted by
+ * @param vars1 tuple of variables for first relation
+ * @param unique_vars variables of the result (see get_unique_vars)
+ * @return columns of the result it is sorted by
+ */
+std::vector<int> join_output_order(const std::vector<int>& order1,
+				   const std::vector<int>& vars1,
+				   const std::vector<int>& unique_vars)
+{
+	std::vector<int> order;
+	for (int col : order1) {
+		int id = std::lower_bound(unique_vars.begin(), unique_vars.end(), vars1[col]) -
+			 unique_vars.begin();
+		if (std::find(order.begin(), order.end(), id) == order.end())
+			order.push_back(id);
+	}
+
+	return order;
+}
+
+/*
+ * Merges relations into one. If they are all sorted on the same
+ * columns, they are merged k-way so that the result is sorted too
+ * (or just concatenated, if each one starts after the previous one
+ * ends); otherwise they are concatenated.
+ *
+ * @param parts relations to merge (consumed)
+ * @return the merged relation
+ */
+Relation<int> merge_sorted(std::vector<Relation<int>>& parts)
+{
+	std::vector<Relation<int>*> sorted;
+	bool same_order = true;
+	for (auto& part : parts)
+		if (part.size() > 0) {
+			same_order &= !part.get_order().empty() &&
+				(sorted.empty() || part.get_order() == sorted.front()->get_order());
+			sorted.push_back(&part);
+		}
+
+	// parts that follow each other in order (e.g. ranges of keys) only need to be concatenated
+	bool in_sequence = true;
+	for (std::size_t i = 0; same_order && i + 1 < sorted.size(); i++) {
+		auto& A = sorted[i]->back();
+		auto& B = *sorted[i + 1]->begin();
+		for (int col : sorted[i]->get_order()) {
+			if (A[col] < B[col])	break;
+			else if (A[col] > B[col]) {	in_sequence = false; break; }
+		}
+	}
+
+	if (!same_order || in_sequence || sorted.size() < 2) {
+		Relation<int> result = std::move(parts.front());
+		for (std::size_t i = 1; i < parts.size(); i++)
+			result.concatenate(parts[i]);
+		return result;
+	}
+
+	// heap of the next tuple of every part, smallest on top
+	using cursor_t = std::pair<Relation<int>::iterator, Relation<int>*>;
+	auto order = sorted.front()->get_order();
+	auto greater = [&order](const cursor_t& a, const cursor_t& b) {
+		for (int i : order) {
+			if ((*a.first)[i] > (*b.first)[i])	return true;
+			else if ((*a.first)[i] < (*b.first)[i])	return false;
+		}
+		return false;
+	};
+	std::vector<cursor_t> heap;
+	for (auto part : sorted)
+		heap.emplace_back(part->begin(), part);
+	std::make_heap(heap.begin(), heap.end(), greater);
+
+	Relation<int> result(sorted.front()->get_arity());
+	while (!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end(), greater);
+		auto& cursor = heap.back();
+		result.push_tuple(std::move(*cursor.first));
+		if (++cursor.first == cursor.second->end())
+			heap.pop_back();
+		else
+			std::push_heap(heap.begin(), heap.end(), greater);
+	}
+	result.set_order(order);
+	for (auto& part : parts)
+		part.clear();
+
+	return result;
+}
+
+/* join keys of at most this many columns are packed into one 64-bit word */
+static const std::size_t MAX_PACKED_COLUMNS = 2;
+
+/* checks whether a join on the columns key compares packed keys (see settings::packed_keys) */
+static bool packable(const std::vector<int>& key)
+{
+	return settings::packed_keys && key.size() <= MAX_PACKED_COLUMNS;
+}
+
+/*
+ * Packs the columns key of a tuple into a word whose unsigned order
+ * is the lexicographic order of the columns: 32 bits per column, with
+ * the sign bit flipped so that negative values come first
+ */
+static inline std::uint64_t pack_key(const Relation<int>::tuple_t& tpl, const std::vector<int>& key)
+{
+	std::uint64_t packed = 0;
+	for (int col : key)
+		packed = (packed << 32) | ((std::uint32_t) tpl[col] ^ 0x80000000u);
+	return packed;
+}
+
+/* packed keys of the tuples of a relation, in its order */
+static std::vector<std::uint64_t> pack_keys(Relation<int>& rel, const std::vector<int>& key)
+{
+	std::vector<std::uint64_t> keys;
+	keys.reserve(rel.size());
+	for (auto& tpl : rel)
+		keys.push_back(pack_key(tpl, key));
+	return keys;
+}
+
+/*
+ * Sorts a relation on perm, whose prefix is the packed key: the
+ * comparisons look at the columns of perm past the key only when the
+ * packed keys are equal
+ */
+static void sort_packed(Relation<int>& rel, const std::vector<int>& key, const std::vector<int>& perm)
+{
+	auto& tuples = rel.flatten();
+	std::vector<std::pair<std::uint64_t, Relation<int>::tuple_t>> keyed;
+	keyed.reserve(tuples.size());
+	for (auto& tpl : tuples) {
+		std::uint64_t packed = pack_key(tpl, key);
+		keyed.emplace_back(packed, std::move(tpl));
+	}
+	std::size_t skip = key.size();
+	std::sort(keyed.begin(), keyed.end(),
+	[&perm, skip](const std::pair<std::uint64_t, Relation<int>::tuple_t>& A,
+		      const std::pair<std::uint64_t, Relation<int>::tuple_t>& B) {
+		if (A.first != B.first)
+			return A.first < B.first;
+		for (std::size_t i = skip; i < perm.size(); i++) {
+			if (A.second[perm[i]] < B.second[perm[i]])	return true;
+			else if (A.second[perm[i]] > B.second[perm[i]])	return false;
+		}
+		return false; });
+	for (std::size_t i = 0; i < tuples.size(); i++)
+		tuples[i] = std::move(keyed[i].second);
+	rel.set_order(perm);
+}
+
+/*
+ * Sorts a relation so that it is sorted on the columns key, the join
+ * key. Nothing is done if it already is. If it is sorted on a prefix
+ * of key only, the runs of tuples equal on that prefix are sorted
+ * separately.
+ *
+ * @param rel relation to sort
+ * @param key columns of the join key
+ * @param perm order to sort by, starting with the key (see get_perm)
+ */
+static void sort_on_key(Relation<int>& rel, const std::vector<int>& key,
+			const std::vector<int>& perm)
+{
+	if (rel.sorted_on(key))
+		return;
+
+	std::size_t prefix = 0;
+	auto& order = rel.get_order();
+	while (prefix < key.size() && prefix < order.size() && order[prefix] == key[prefix])
+		prefix++;
+	if (prefix == 0) {
+		// sorting on the packed key, then on the rest of perm, sorts on perm if the key is its prefix
+		if (packable(key) && std::equal(key.begin(), key.end(), perm.begin()) && !rel.sorted_on(perm))
+			sort_packed(rel, key, perm);
+		else
+			sort(rel, perm);
+		return;
+	}
+
+	auto less = [&perm](const Relation<int>::tuple_t& A, const Relation<int>::tuple_t& B) {
+		for (int i : perm) {
+			if (A[i] < B[i])	return true;
+			else if (A[i] > B[i])	return false;
+		}
+		return false;
+	};
+	auto same_prefix = [&key, prefix](const Relation<int>::tuple_t& A, const Relation<int>::tuple_t& B) {
+		for (std::size_t i = 0; i < prefix; i++)
+			if (A[key[i]] != B[key[i]])
+				return false;
+		return true;
+	};
+	auto& tuples = rel.flatten();
+	for (auto run = tuples.begin(); run != tuples.end();) {
+		auto end = run;
+		while (end != tuples.end() && same_prefix(*run, *end))
+			end++;
+		std::sort(run, end, less);
+		run = end;
+	}
+
+	std::vector<int> new_order(key.begin(), key.begin() + prefix);
+	for (int col : perm)
+		if (std::find(new_order.begin(), new_order.end(), col) == new_order.end())
+			new_order.push_back(col);
+	rel.set_order(new_order);
+}
+
+/* steps of a join between two polls of its stopping condition */
+static const std::size_t POLL_INTERVAL = 1024;
+
+/* compares the join keys of two tuples through the matching vectors (see compare_assignments) */
+struct AssignmentCompare {
+	const std::vector<int>& matching1;
+	const std::vector<int>& matching2;
+
+	int operator()(const Relation<int>::tuple_t& tpl1, std::size_t,
+		       const Relation<int>::tuple_t& tpl2, std::size_t) const
+	{
+		return compare_assignments(tpl1, matching1, tpl2, matching2);
+	}
+};
+
+/* compares the packed join keys of two tuples, given their positions (see pack_keys) */
+struct PackedCompare {
+	const std::vector<std::uint64_t>& keys1;
+	const std::vector<std::uint64_t>& keys2;
+
+	int operator()(const Relation<int>::tuple_t&, std::size_t i1,
+		       const Relation<int>::tuple_t&, std::size_t i2) const
+	{
+		return (keys1[i1] > keys2[i2]) - (keys1[i1] < keys2[i2]);
+	}
+};
+
+/*
+ * Merges two relations sorted on the join key into join_rel (see join)
+ *
+ * @param compare compares the keys of a tuple of rel1 and a tuple of
+ * 	  rel2, given with their positions in the relations
+ */
+template<typename Compare>
+static void merge_join(Relation<int>& rel1, Relation<int>& rel2,
+		       const std::vector<int>& vars1, const std::vector<int>& vars2,
+		       const std::vector<int>& unique_vars, const Selection& selection,
+		       const Compare& compare, std::size_t limit,
+		       const std::function<bool()>& stopped, Relation<int>& join_rel)
+{
+	auto it1 = rel1.begin();
+	auto it2 = rel2.begin();
+	std::size_t i1 = 0, i2 = 0;
+	bool done = false;
+	std::size_t steps = 0;
+	while (!done && it1 != rel1.end() && it2 != rel2.end()) {
+		if (stopped && ++steps % POLL_INTERVAL == 0 && stopped())
+			break;
+		int comp = compare(*it1, i1, *it2, i2);
+
+		if (!consistent(*it1, vars1)) it1++, i1++;
+		else if (!consistent(*it2, vars2)) it2++, i2++;
+		else if (comp < 0) it1++, i1++;
+		else if (comp > 0) it2++, i2++;
+		else {
+			std::size_t i3 = i2;
+			for (auto it3 = it2; !done && it3 != rel2.end() && 
+			     compare(*it1, i1, *it3, i3) == 0;
+			     it3++, i3++) {
+				auto tpl = merge_reduce_tpls(*it1, *it3, vars1, vars2, unique_vars);
+				if (selection(tpl)) {
+					join_rel.push_tuple(std::move(tpl));
+					done = (join_rel.size() == limit);
+				}
+			}
+
+			it1++, i1++;
+		}
+	}
+}
+
 /*
  * Performs join operation in two relations.
+ * A relation already sorted on the join key (see Relation::get_order)
+ * is not sorted again, and the result is sorted like the first one.
+ * If settings::memory_budget is set and the two relations take more
+ * memory than the budget, the join is computed out of core (see
+ * external.h).
  *
  * @param rel1 first relation
  * @param rel2 second relation
  * @param vars1 tuple of variables for first relation
  * @param vars2 tuple of variables for second relation
+ * @param limit the join stops once it has produced limit tuples (0: no limit)
+ * @param stopped if set, polled every POLL_INTERVAL steps; the join
+ * 	  stops as soon as it returns true
+ * @param predicates predicates of the query; the join evaluates the ones
+ * 	  it binds (see join_predicates) on each result tuple
  * @return result of join operation
  */
 Relation<int> join(Relation<int>& rel1,
 		   Relation<int>& rel2,
 		   const std::vector<int>& vars1,
-     		   const std::vector<int>& vars2)
+     		   const std::vector<int>& vars2,
+		   std::size_t limit,
+		   const std::function<bool()>& stopped,
+		   const std::vector<Predicate>& predicates)
 {
+	PhaseScope phase(Phase::Join);
+	std::size_t size1 = rel1.size(), size2 = rel2.size();
+	if (settings::memory_budget > 0 &&
+	    memory_footprint(rel1) + memory_footprint(rel2) > settings::memory_budget) {
+		auto join_rel = external_join(rel1, rel2, vars1, vars2, settings::memory_budget, limit, stopped,
+					      predicates);
+		record_join(size1, size2, join_rel.size());
+		return join_rel;
+	}
+
 	auto common_vars = common_elems(vars1, vars2);	
 	auto unique_vars = get_unique_vars(vars1, vars2);
+	Selection selection(join_predicates(predicates, vars1, vars2, unique_vars), unique_vars);
 	auto matching1 = index_common_variables(vars1, common_vars);
 	auto matching2 = index_common_variables(vars2, common_vars);
 
-	sort(rel1, get_perm(vars1, common_vars));
-	sort(rel2, get_perm(vars2, common_vars));
+	{
+		PhaseScope sort_phase(Phase::Sort);
+		sort_on_key(rel1, matching1, get_perm(vars1, common_vars));
+		sort_on_key(rel2, matching2, get_perm(vars2, common_vars));
+	}
 
 	Relation<int> join_rel(unique_vars.size());
+	// a short key is packed once per tuple, and the merge compares words
+	if (packable(matching1)) {
+		auto keys1 = pack_keys(rel1, matching1), keys2 = pack_keys(rel2, matching2);
+		merge_join(rel1, rel2, vars1, vars2, unique_vars, selection, PackedCompare{keys1, keys2},
+			   limit, stopped, join_rel);
+	} else
+		merge_join(rel1, rel2, vars1, vars2, unique_vars, selection,
+			   AssignmentCompare{matching1, matching2}, limit, stopped, join_rel);
+	join_rel.set_order(join_output_order(rel1.get_order(), vars1, unique_vars));
+	record_join(size1, size2, join_rel.size());
 
-	auto it1 = rel1.begin();
-	auto it2 = rel2.begin();
-	while (it1 != rel1.end() && it2 != rel2.end()) {
-		int comp = compare_assignments(*it1, matching1, *it2, matching2);
+	return join_rel;
+}
 
-		if (!consistent(*it1, vars1)) it1++;
-		else if (!consistent(*it2, vars2)) it2++;
-		else if (comp < 0) it1++;
-		else if (comp > 0) it2++;
-		else {
-			for (auto it3 = it2; it3 != rel2.end() && 
-			     compare_assignments(*it1, matching1, *it3, matching2) == 0;
-			     it3++)
-			     join_rel.push_tuple(merge_reduce_tpls(*it1, *it3,
-			     			     vars1, vars2, unique_vars));	
+std::vector<int> remaining_vars(const std::vector<std::vector<int>>& varsv, std::size_t first)
+{
+	std::set<int> vars_set;
+	for (std::size_t i = first; i < varsv.size(); i++)
+		vars_set.insert(varsv[i].begin(), varsv[i].end());
+	return std::vector<int>(vars_set.begin(), vars_set.end());
+}
 
-			it1++;
+std::vector<int> live_vars(const std::vector<int>& vars, const std::vector<int>& later_vars,
+			   const std::vector<int>& output_vars, const std::vector<Predicate>& predicates,
+			   const GroupBy& group_by)
+{
+	if (output_vars.empty() && group_by.empty())
+		return vars;
+
+	std::set<int> needed{later_vars.begin(), later_vars.end()};
+	needed.insert(output_vars.begin(), output_vars.end());
+	needed.insert(group_by.group_vars.begin(), group_by.group_vars.end());
+	for (auto& aggregate : group_by.aggregates)
+		if (aggregate.op != AggregateOp::Count)
+			needed.insert(aggregate.var);
+	for (auto& predicate : predicates)
+		if (bound_predicates({predicate}, vars).empty()) {
+			needed.insert(predicate.var);
+			if (!predicate.constant)
+				needed.insert(predicate.rhs);
 		}
+
+	// a repeated variable keeps a single column: project checks the others against it
+	std::vector<int> keep;
+	for (int var : vars)
+		if (needed.count(var) && std::find(keep.begin(), keep.end(), var) == keep.end())
+			keep.push_back(var);
+	// a relation without columns could not count its tuples
+	if (keep.empty() && !vars.empty())
+		keep.push_back(vars.front());
+	return keep;
+}
+
+void project(Relation<int>& rel, const std::vector<int>& vars, const std::vector<int>& keep)
+{
+	if (keep == vars)
+		return;
+
+	std::vector<int> coords;
+	for (int var : keep) {
+		auto it = std::find(vars.begin(), vars.end(), var);
+		if (it == vars.end())
+			throw std::invalid_argument("Projection on variable " + std::to_string(var) +
+						    ", which is not bound");
+		coords.push_back(it - vars.begin());
+	}
+	// the order survives up to its first dropped column
+	std::vector<int> order;
+	for (int coord : rel.get_order()) {
+		auto it = std::find(coords.begin(), coords.end(), coord);
+		if (it == coords.end())
+			break;
+		order.push_back(it - coords.begin());
 	}
 
-	return join_rel;
+	// a dropped copy of a repeated variable can no longer be checked by a join
+	bool repeated = std::set<int>(vars.begin(), vars.end()).size() < vars.size();
+	Relation<int> projected(keep.size());
+	for (auto& tpl : rel) {
+		if (repeated && !consistent(tpl, vars))
+			continue;
+		std::vector<int> kept(coords.size());
+		for (std::size_t i = 0; i < coords.size(); i++)
+			kept[i] = tpl[coords[i]];
+		projected.push_tuple(std::move(kept));
+	}
+	projected.set_order(order);
+	rel = std::move(projected);
+}
+
+void distinct(Relation<int>& rel)
+{
+	// the order is on distinct columns: if it has them all, equal tuples are adjacent
+	std::vector<int> order = rel.get_order();
+	if (order.size() < rel.get_arity()) {
+		order.resize(rel.get_arity());
+		for (std::size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		sort(rel, order);
+	}
+
+	Relation<int> unique_rel(rel.get_arity());
+	bool first = true;
+	for (auto& tpl : rel) {
+		if (!first && tpl == unique_rel.back())
+			continue;
+		unique_rel.push_tuple(std::move(tpl));
+		first = false;
+	}
+	unique_rel.set_order(order);
+	rel = std::move(unique_rel);
 }
 
 /*
  * Performs join operation for multiple relations.
+ * Only the last join stops at the limit: any prefix of an intermediate
+ * result could miss the tuples that extend into the final result. An
+ * empty intermediate result ends the computation.
  *
  * @param rel_namesv vector containing the names of relation files
  * @param varsv	vector of corresponding variables
  * @param result_vars vector to identify variables in the resulting relation
+ * @param limit at most limit tuples are computed (0: all of them)
+ * @param predicates selection predicates, evaluated when a relation is
+ * 	  read if it binds their variables, or else by the first join that does
+ * @param group_by aggregation of the result
+ * @param output_vars variables of the result (empty: all of them)
  * @return result of join operation as a new relation
  */
 Relation<int> multiway_join(std::vector<std::string>& rel_namesv,
 		   std::vector<std::vector<int>>& varsv,
-		   std::vector<int>& result_vars)
+		   std::vector<int>& result_vars, std::size_t limit,
+		   const std::vector<Predicate>& predicates, const GroupBy& group_by,
+		   const std::vector<int>& output_vars)
 {
-	
-	Relation<int> result_rel(read_arity(rel_namesv.front()));
-	read_relation(rel_namesv.front(),  result_rel);
+	CatalogScope scope;
+	// with an aggregation, the limit is on the groups rather than on the tuples they aggregate,
+	// and without duplicates, on the distinct tuples
+	std::size_t join_limit = (group_by.empty() && !settings::distinct_result) ? limit : 0;
+	Relation<int> result_rel;
+	load_relation(rel_namesv.front(), result_rel);
 	result_vars = varsv.front();
+	select_tuples(result_rel, result_vars, predicates);
+	std::vector<int> kept_vars = live_vars(result_vars, remaining_vars(varsv, 1), output_vars,
+					       predicates, group_by);
+	project(result_rel, result_vars, kept_vars);
+	result_vars = kept_vars;
 
 	auto rel_it = ++rel_namesv.begin();
 	auto vars_it = ++varsv.begin();
 	for(;rel_it != rel_namesv.end();rel_it++,vars_it++) {
-		Relation<int> buff_rel(read_arity(*rel_it));
-		read_relation(*rel_it, buff_rel);
-		result_rel = join(result_rel, buff_rel, result_vars, *vars_it);
-		result_vars = get_unique_vars(result_vars, *vars_it);	
+		bool last = (rel_it + 1 == rel_namesv.end());
+		std::vector<int> later_vars = remaining_vars(varsv, vars_it - varsv.begin() + 1);
+		Relation<int> buff_rel;
+		std::vector<int> buff_vars = *vars_it;
+		// a binary relation sharing a variable with the result is probed through its index
+		const CsrIndex* index = nullptr;
+		if (settings::csr_index && !settings::distinct_inputs && vars_it->size() == 2 &&
+		    !common_elems(result_vars, *vars_it).empty())
+			index = relation_catalog().index(*rel_it);
+		if (index) {
+			result_rel = index_join(result_rel, *index, result_vars, buff_vars, last ? join_limit : 0,
+						std::function<bool()>(), predicates);
+		} else {
+			if (result_rel.size() > 0) {
+				load_relation(*rel_it, buff_rel);
+				select_tuples(buff_rel, buff_vars, predicates);
+				buff_vars = live_vars(*vars_it, get_unique_vars(result_vars, later_vars), output_vars,
+						      predicates, group_by);
+				project(buff_rel, *vars_it, buff_vars);
+			}
+			result_rel = join(result_rel, buff_rel, result_vars, buff_vars, last ? join_limit : 0,
+					  std::function<bool()>(), predicates);
+		}
+		result_vars = get_unique_vars(result_vars, buff_vars);
+		kept_vars = live_vars(result_vars, later_vars, output_vars, predicates, group_by);
+		project(result_rel, result_vars, kept_vars);
+		result_vars = kept_vars;
+	}
+	if (!group_by.empty()) {
+		result_rel = aggregate_groups(result_rel, result_vars, group_by);
+		result_vars = aggregate_vars(group_by, result_vars);
+	} else if (!output_vars.empty()) {
+		project(result_rel, result_vars, output_vars);
+		result_vars = output_vars;
 	}
+	if (settings::distinct_result && group_by.empty()) // the groups are distinct already
+		distinct(result_rel);
+	if (limit > 0) // a query of a single relation has no join
+		result_rel.truncate(limit);
 
 	return result_rel;
 }
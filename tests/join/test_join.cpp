@@ -5,20 +5,29 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <functional>
 #include <boost/mpi.hpp>
 #include <boost/mpi/collectives.hpp>
+#include "communicator.h"
+#include "fingerprint.h"
+#include "memstats.h"
+#include "profile.h"
 #include "ioutil.h"
 #include "mpiutil.h"
 #include "util.h"
 #include "debug.h"
+#include "settings.h"
 
 using namespace std;
 
 const string RELATIONS_PATH("tests/join/relations/");
 const string INPUTS_PATH("tests/join/inputs/");
 const string ANSWERS_PATH("tests/join/outputs/");
+// answers of the queries whose relations have duplicates, computed on the deduplicated relations
+const string DISTINCT_ANSWERS_PATH("tests/join/distinct_outputs/");
 
-void read_test(const string filename, vector<string>& rel_namesv, vector<vector<int>>& varsv)
+void read_test(const string filename, vector<string>& rel_namesv, vector<vector<int>>& varsv,
+	       vector<Predicate>& predicates, GroupBy& group_by, vector<int>& output_vars)
 {
 	ifstream f(filename);
 	if(!f)
@@ -42,11 +51,52 @@ void read_test(const string filename, vector<string>& rel_namesv, vector<vector<
 		for(int j=0; j<arity; j++)
 			f>>varsv[i][j];
 	}
+	// optional selection predicates: their number, then one per line ("0 < 1", "2 != #5")
+	int num_predicates = 0;
+	f>>num_predicates;
+	for(int i=0; i<num_predicates; i++)
+	{
+		string lhs, op, rhs; f>>lhs>>op>>rhs;
+		predicates.push_back(parse_predicate(lhs, op, rhs));
+	}
+	check_predicates(predicates, varsv);
+	// optional aggregation: the number of group variables and the variables,
+	// then the number of aggregates and one per line ("count", "max 2")
+	int num_group_vars = 0, num_aggregates = 0;
+	if(f>>num_group_vars)
+	{
+		group_by.group_vars.resize(num_group_vars);
+		for(int i=0; i<num_group_vars; i++)
+			f>>group_by.group_vars[i];
+		f>>num_aggregates;
+	}
+	for(int i=0; i<num_aggregates; i++)
+	{
+		string op; int var = 0; f>>op;
+		if(op != "count")
+			f>>var;
+		group_by.aggregates.push_back(parse_aggregate(op, var));
+	}
+	// optional output variables: their number, then the variables, in the order of the result
+	int num_output_vars = 0;
+	f>>num_output_vars;
+	output_vars.resize(num_output_vars);
+	for(int i=0; i<num_output_vars; i++)
+	{
+		f>>output_vars[i];
+		bool bound = false;
+		for(auto& vars : varsv)
+			bound = bound || find(vars.begin(), vars.end(), output_vars[i]) != vars.end();
+		if(!bound)
+			throw invalid_argument("Output variable " + to_string(output_vars[i]) + " is in no relation");
+	}
+	if(!output_vars.empty() && !group_by.empty())
+		throw invalid_argument("A query has either output variables or an aggregation");
 	f.close();
 }
 
 void throw_error(string s =
-	"Usage: mpirun -np <number of processes> bin/test_join <name of input> <sequential, normal_distrib, optimized_distrib, hypercube> [<mod_hash, mult_hash, murmur_hash>]"){
+	"Usage: mpirun -np <number of processes> bin/test_join <name of input> <sequential, normal_distrib, optimized_distrib, hypercube> [<mod_hash, mult_hash, murmur_hash, tab_hash>]"){
 	mpi::communicator world;
 	if(world.rank() == constants::ROOT){
 			cout<<"###################"<<endl;
@@ -65,6 +115,13 @@ int main(int argc, char* argv[]) {
     list_names_hash[string("mod_hash")]= HashMethod::ModHash; 
     list_names_hash[string("mult_hash")]= HashMethod::MultHash; 
     list_names_hash[string("murmur_hash")]= HashMethod::MurmurHash;     
+    list_names_hash[string("tab_hash")]= HashMethod::TabulationHash;
+
+	try {
+		parse_settings(argc, argv);
+	} catch (std::invalid_argument& e) {
+		throw_error(e.what());
+	}
 
 	if(argc <3)
 		throw_error();
@@ -73,7 +130,7 @@ int main(int argc, char* argv[]) {
 	if(find(list_names_algorithms.begin(), list_names_algorithms.end(), name_algorithm)==list_names_algorithms.end())
 		throw_error("Invalid algorithm option");
 
-	HashMethod hash_method;
+	HashMethod hash_method = HashMethod::ModHash;
 	if(name_algorithm!="sequential"){
 		if(argc<4)
 			hash_method =  HashMethod::ModHash; // by default
@@ -82,6 +139,7 @@ int main(int argc, char* argv[]) {
 			string name_hash = string(argv[3]);
 			if(!list_names_hash.count(name_hash))
 				throw_error("Invalid hash method");		
+			hash_method = list_names_hash[name_hash];
 		}
 	}	
 	
@@ -92,27 +150,105 @@ int main(int argc, char* argv[]) {
 
 	vector<string> rel_namesv;
 	vector< vector<int> > varsv;	
-	read_test(filename, rel_namesv, varsv);
+	vector<Predicate> predicates;
+	GroupBy group_by;
+	vector<int> output_vars;
+	try {
+		read_test(filename, rel_namesv, varsv, predicates, group_by, output_vars);
+	} catch (std::invalid_argument& e) {
+		throw_error(e.what());
+	}
+	// a result left in parts is checked by its fingerprint, and the other way round
+	if (settings::check_fingerprint || !settings::gather_result) {
+		if (settings::result_limit > 0)
+			throw_error("The result of a limited query cannot be checked by its fingerprint");
+		settings::check_fingerprint = true;
+		settings::gather_result = false;
+	}
+	string answer_filename = ANSWERS_PATH+string(argv[1]);
+	if (settings::distinct_inputs && ifstream(DISTINCT_ANSWERS_PATH+string(argv[1])))
+		answer_filename = DISTINCT_ANSWERS_PATH+string(argv[1]);
 	Relation<int> result;	
 	vector<int> result_vars;	
-	if(name_algorithm == "sequential")
-		result = multiway_join(rel_namesv, varsv, result_vars);
-	else if(name_algorithm == "normal_distrib")
-		result = distributed_multiway_join(rel_namesv, varsv, result_vars, false, hash_method);
-	else if(name_algorithm =="optimized_distrib")
-		result = distributed_multiway_join(rel_namesv, varsv, result_vars, true, hash_method);
-	else if(name_algorithm == "hypercube")
-		result = hypercube_distributed_multiway_join(rel_namesv, varsv, result_vars, hash_method);			
-	
+	Fingerprint result_fingerprint{0, 0, 0};
+	// with --threads=N the distributed algorithms run on N threads of this process
+	function<void()> run = [&]() {
+		Relation<int> local_result;
+		vector<int> local_vars;
+		if(name_algorithm == "sequential")
+			local_result = multiway_join(rel_namesv, varsv, local_vars, settings::result_limit, predicates, group_by, output_vars);
+		else if(name_algorithm == "normal_distrib")
+			local_result = distributed_multiway_join(rel_namesv, varsv, local_vars, false, hash_method,
+								 settings::result_limit, predicates, group_by, output_vars);
+		else if(name_algorithm =="optimized_distrib")
+			local_result = distributed_multiway_join(rel_namesv, varsv, local_vars, true, hash_method,
+								 settings::result_limit, predicates, group_by, output_vars);
+		else if(name_algorithm == "hypercube")
+			local_result = hypercube_distributed_multiway_join(rel_namesv, varsv, local_vars, hash_method,
+									   settings::result_limit, predicates, group_by, output_vars);			
+
+		if (settings::compress_shuffles || settings::report_shuffles)
+			report_shuffles(cout);
+		if (settings::report_memory)
+			report_memory(cout);
+		if (settings::report_profile) {
+			ofstream profile_file;
+			if (!settings::profile_file.empty() && current_communicator().rank() == constants::ROOT)
+				profile_file.open(settings::profile_file);
+			report_profile(settings::profile_file.empty() ? cout : profile_file);
+		}
+
+		// every process of the sequential join computes the whole result
+		Fingerprint fp{0, 0, 0};
+		if (settings::check_fingerprint)
+			fp = (name_algorithm == "sequential") ? fingerprint(local_result) : distributed_fingerprint(local_result);
+		if (current_communicator().rank() == constants::ROOT) {
+			result = std::move(local_result);
+			result_vars = local_vars;
+			result_fingerprint = fp;
+		}
+	};
+	if (settings::threads > 0 && name_algorithm != "sequential")
+		run_on_threads(settings::threads, run);
+	else
+		run();
+
+	if (world.rank() == constants::ROOT && settings::check_fingerprint) {
+		pv(result_vars);
+		cout << endl << "fingerprint " << result_fingerprint << endl;
 
-	if (world.rank() == constants::ROOT) {
+		// the reference is the fingerprint file, written by this run if it does not exist yet, or the answer file
+		Fingerprint reference;
+		if (!settings::fingerprint_file.empty()) {
+			ifstream fingerprint_file(settings::fingerprint_file);
+			if (!fingerprint_file) {
+				ofstream(settings::fingerprint_file) << result_fingerprint << endl;
+				cout << "Fingerprint written to " << settings::fingerprint_file << endl;
+				return 0;
+			}
+			if (!(fingerprint_file >> reference))
+				throw_error("Invalid fingerprint file");
+		} else {
+			if (!ifstream(answer_filename))
+				return 0;
+			Relation<int> right_answer(read_arity(answer_filename));
+			read_relation(answer_filename, right_answer);
+			if (settings::distinct_result)
+				distinct(right_answer);
+			reference = fingerprint(right_answer);
+		}
+		if (result_fingerprint == reference)
+			cout<<"Answer is CORRECT"<<endl;
+		else
+			cout<<"Answer is WRONG (expected fingerprint "<<reference<<")"<<endl;
+	}
+	else if (world.rank() == constants::ROOT) {
 		pv(result_vars);
 		cout << endl;
 		for (auto it = result.begin(); it != result.end(); it++)
 			pv(*it);
 
 		
-		string answer_filename = ANSWERS_PATH+string(argv[1]);
 		ifstream answer_file(answer_filename);
 		if(!answer_file) // end program if there is no verification file
 			return 0;
@@ -141,7 +277,22 @@ int main(int argc, char* argv[]) {
 		cout<<"------"<<endl;
 		cout<<right_answer<<endl;
 		cout<<"------"<<endl;
-		if (m1.size() == m2.size() && std::equal(m1.begin(), m1.end(),m2.begin())){
+		// the answer files keep the duplicates: a distinct result has each tuple once
+		size_t answer_size = right_answer.size();
+		if (settings::distinct_result) {
+			for (auto& entry : m1)
+				entry.second = 1;
+			answer_size = m1.size();
+		}
+		// with a limit, any min(limit, size of the answer) tuples of the answer are right
+		bool correct = true;
+		if (settings::result_limit > 0) {
+			for (auto& entry : m2)
+				correct = correct && m1.count(entry.first) && m1[entry.first] >= entry.second;
+			correct = correct && result.size() == min(settings::result_limit, answer_size);
+		} else
+			correct = m1.size() == m2.size() && std::equal(m1.begin(), m1.end(), m2.begin());
+		if (correct){
 			cout<<"Answer is CORRECT"<<endl;
 		}
 		else
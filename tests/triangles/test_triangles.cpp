@@ -5,12 +5,18 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <functional>
 #include <boost/mpi.hpp>
 #include <boost/mpi/collectives.hpp>
+#include "communicator.h"
+#include "fingerprint.h"
+#include "memstats.h"
+#include "profile.h"
 #include "ioutil.h"
 #include "mpiutil.h"
 #include "util.h"
 #include "debug.h"
+#include "settings.h"
 
 using namespace std;
 
@@ -18,7 +24,7 @@ const string INPUTS_PATH("tests/triangles/inputs/");
 const string ANSWERS_PATH("tests/triangles/outputs/");
 	
 void throw_error(string s =
-	"Usage: mpirun -np <number of processes> bin/test_join <name of input> <sequential, normal_distrib, optimized_distrib, hypercube> [<mod_hash, mult_hash, murmur_hash>]"){
+	"Usage: mpirun -np <number of processes> bin/test_triangles <name of input> <sequential, normal_distrib, optimized_distrib, hypercube> [<mod_hash, mult_hash, murmur_hash, tab_hash> [ordered]]"){
 	mpi::communicator world;
 	if(world.rank() == constants::ROOT){
 			cout<<"###################"<<endl;
@@ -37,6 +43,13 @@ int main(int argc, char* argv[]) {
     list_names_hash[string("mod_hash")]= HashMethod::ModHash; 
     list_names_hash[string("mult_hash")]= HashMethod::MultHash; 
     list_names_hash[string("murmur_hash")]= HashMethod::MurmurHash;     
+    list_names_hash[string("tab_hash")]= HashMethod::TabulationHash;
+
+	try {
+		parse_settings(argc, argv);
+	} catch (std::invalid_argument& e) {
+		throw_error(e.what());
+	}
 
 	if(argc <3)
 		throw_error();
@@ -45,7 +58,7 @@ int main(int argc, char* argv[]) {
 	if(find(list_names_algorithms.begin(), list_names_algorithms.end(), name_algorithm)==list_names_algorithms.end())
 		throw_error("Invalid algorithm option");
 
-	HashMethod hash_method;
+	HashMethod hash_method = HashMethod::ModHash;
 	if(name_algorithm!="sequential"){
 		if(argc<4)
 			hash_method =  HashMethod::ModHash; // by default
@@ -54,6 +67,7 @@ int main(int argc, char* argv[]) {
 			string name_hash = string(argv[3]);
 			if(!list_names_hash.count(name_hash))
 				throw_error("Invalid hash method");		
+			hash_method = list_names_hash[name_hash];
 		}
 	}	
 	
@@ -71,21 +85,82 @@ int main(int argc, char* argv[]) {
 	varsv.push_back(std::vector<int>{0,1});
 	varsv.push_back(std::vector<int>{1,2});
 	varsv.push_back(std::vector<int>{2,0});	
+	// "ordered": list each triangle once, as x0 < x1 < x2, instead of once per rotation and orientation
+	vector<Predicate> predicates;
+	if(argc > 4 && string(argv[4]) == "ordered") {
+		predicates.push_back(parse_predicate("0", "<", "1"));
+		predicates.push_back(parse_predicate("1", "<", "2"));
+	}
 	
+	if (!settings::gather_result && settings::result_limit > 0)
+		throw_error("The result of a limited query cannot be left in parts");
 	Relation<int> result;	
 	vector<int> result_vars;	
-	if(name_algorithm == "sequential")
-		result = multiway_join(rel_namesv, varsv, result_vars);
-	else if(name_algorithm == "normal_distrib")
-		result = distributed_multiway_join(rel_namesv, varsv, result_vars, false, hash_method);
-	else if(name_algorithm =="optimized_distrib")
-		result = distributed_multiway_join(rel_namesv, varsv, result_vars, true, hash_method);
-	else if(name_algorithm == "hypercube")
-		result = hypercube_distributed_multiway_join(rel_namesv, varsv, result_vars, hash_method);			
-	
+	size_t triangles = 0;
+	Fingerprint result_fingerprint{0, 0, 0};
+	// with --threads=N the distributed algorithms run on N threads of this process
+	function<void()> run = [&]() {
+		Relation<int> local_result;
+		vector<int> local_vars;
+		if(name_algorithm == "sequential")
+			local_result = multiway_join(rel_namesv, varsv, local_vars, settings::result_limit, predicates);
+		else if(name_algorithm == "normal_distrib")
+			local_result = distributed_multiway_join(rel_namesv, varsv, local_vars, false, hash_method,
+								 settings::result_limit, predicates);
+		else if(name_algorithm =="optimized_distrib")
+			local_result = distributed_multiway_join(rel_namesv, varsv, local_vars, true, hash_method,
+								 settings::result_limit, predicates);
+		else if(name_algorithm == "hypercube")
+			local_result = hypercube_distributed_multiway_join(rel_namesv, varsv, local_vars, hash_method,
+									   settings::result_limit, predicates);			
+
+		if (settings::compress_shuffles || settings::report_shuffles)
+			report_shuffles(cout);
+		if (settings::report_memory)
+			report_memory(cout);
+		if (settings::report_profile) {
+			ofstream profile_file;
+			if (!settings::profile_file.empty() && current_communicator().rank() == constants::ROOT)
+				profile_file.open(settings::profile_file);
+			report_profile(settings::profile_file.empty() ? cout : profile_file);
+		}
+
+		// a result left in parts is counted where it is; every process of the sequential join computes the whole result
+		bool in_parts = !settings::gather_result && name_algorithm != "sequential";
+		std::vector<std::size_t> count{local_result.size()};
+		if (in_parts)
+			current_communicator().reduce(count, ReduceOp::Sum, constants::ROOT);
+		Fingerprint fp{0, 0, 0};
+		if (settings::check_fingerprint)
+			fp = in_parts ? distributed_fingerprint(local_result) : fingerprint(local_result);
+		if (current_communicator().rank() == constants::ROOT) {
+			result = std::move(local_result);
+			result_vars = local_vars;
+			triangles = count[0];
+			result_fingerprint = fp;
+		}
+	};
+	if (settings::threads > 0 && name_algorithm != "sequential")
+		run_on_threads(settings::threads, run);
+	else
+		run();
 
 	if (world.rank() == constants::ROOT) {
-		cout<<"We detected "<<result.size()<<" triangles"<<endl;
+		cout<<"We detected "<<triangles<<" triangles"<<endl;
+		if (settings::check_fingerprint)
+			cout<<"fingerprint "<<result_fingerprint<<endl;
+		// compared with the fingerprint file, written by this run if it does not exist yet
+		if (settings::check_fingerprint && !settings::fingerprint_file.empty()) {
+			Fingerprint reference;
+			ifstream fingerprint_file(settings::fingerprint_file);
+			if (!fingerprint_file) {
+				ofstream(settings::fingerprint_file) << result_fingerprint << endl;
+				cout<<"Fingerprint written to "<<settings::fingerprint_file<<endl;
+			} else if (fingerprint_file >> reference)
+				cout<<(result_fingerprint == reference ? "Answer is CORRECT" : "Answer is WRONG")<<endl;
+			else
+				throw_error("Invalid fingerprint file");
+		}
 	}
 
 